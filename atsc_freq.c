@@ -0,0 +1,39 @@
+/* atsc_freq.c -- US broadcast RF channel plan
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ */
+
+#include "atsc_freq.h"
+
+/* Center frequencies for NTSC channels */
+static int ntsc[ ] = { 
+ 0,  0,  57,  63,  69,  79,  85, 177, 183, 189 ,
+ 195, 201, 207, 213, 473, 479, 485, 491, 497, 503 ,
+ 509, 515, 521, 527, 533, 539, 545, 551, 557, 563 ,
+ 569, 575, 581, 587, 593, 599, 605, 611, 617, 623 ,
+ 629, 635, 641, 647, 653, 659, 665, 671, 677, 683 ,
+ 689, 695, 701, 707, 713, 719, 725, 731, 737, 743 ,
+ 749, 755, 761, 767, 773, 779, 785, 791, 797, 803 
+};
+
+
+int atsc_channel_hz( int rf_channel )
+{
+	if( rf_channel < 0 || rf_channel >= ATSC_NUM_CHANNELS )
+		return 0;
+
+	return ntsc[rf_channel] * 1000000;
+}
+
+int atsc_hz_channel( unsigned long hz )
+{
+	int i;
+
+	for( i = 2; i < ATSC_NUM_CHANNELS; i++ )
+	{
+		if( (unsigned long) ntsc[i] * 1000000 == hz )
+			return i;
+	}
+
+	return -1;
+}
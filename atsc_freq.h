@@ -0,0 +1,17 @@
+#ifndef _ATSC_FREQ_H_
+#define _ATSC_FREQ_H_
+/* atsc_freq.h -- US broadcast RF channel plan
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ */
+
+#define ATSC_NUM_CHANNELS                     70
+
+/* Center frequency in Hz of RF channel 2..69, 0 if the channel does not exist */
+extern int atsc_channel_hz( int rf_channel );
+
+/* RF channel whose center frequency is hz, -1 if none */
+extern int atsc_hz_channel( unsigned long hz );
+
+
+#endif /* _ATSC_FREQ_H_ */
@@ -0,0 +1,864 @@
+/* atsc_scan.c -- embeddable ATSC channel scanner
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Loop Thourgh US UHF Freq Table
+ *	IF Found LOCK on HZ
+ *		IF WE HAVE STABLE LOCK
+ *		   SCAN TS STREAM FOR (T)/(C)VCT SECTIONS
+ *			REPORT EACH VIRTUAL CHANNEL
+ *
+ * ATSC Standard Revision B (A65/B)
+ *
+ * atsc_scan_range() runs as a two stage pipeline: the calling thread
+ * tunes, dwells and copies the raw VCT and PAT sections of frequency N
+ * into a capture slot, hands the slot over and retunes to N+1 straight
+ * away, while a worker thread decodes N and runs the callbacks. Slots are
+ * reported strictly in the order they were captured, and the signal
+ * samples are kept in the slot and replayed before its channels, so the
+ * callbacks see exactly the sequence a serial scan would produce.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "atsc_freq.h"
+#include "dvb_device.h"
+#include "atsc_scan.h"
+#include "hex_dump.h"
+
+// -- This is 32 for Air2PC cards but lets be nice other might have different cards.
+#if !defined(DMX_FILTER_SIZE)
+#define DMX_FILTER_SIZE 16
+#endif
+
+#define SERVICE_LOCATION_DESCRIPTOR         0xA1
+#define MAX_SECTION_SIZE                    4096
+#define DVB_TIMEOUT                         9000 /* Previously 8360 */
+
+#define VCT_SECTION_SIZE                    1024
+#define VCT_MAX_SECTIONS                       8
+#define VCT_HDR_OFFSET                        10
+#define VCT_ITEM_SIZE                         32
+#define VCT_CRC_SIZE                           4
+#define PAT_PID                           0x0000
+#define PAT_TABLE_ID                        0x00
+#define PAT_SECTION_SIZE                    1024
+#define PAT_HDR_OFFSET                         8
+#define PAT_TIMEOUT                         1000 /* A/53 repeats it every 100 ms */
+#define SLD_ELEMENT_SIZE                       6
+#define MAX_OVERFLOWS                          3
+#define PIPELINE_DEPTH                         4  /* capture slots in flight */
+#define PROBE_POLL_US                      10000
+#define DEBUG                                  0
+
+/* Raw VCT sections captured on one frequency, not decoded yet */
+struct vct_capture {
+	struct atsc_frequency summary;
+	struct atsc_signal *samples;      /* deferred signal callbacks, NULL = call directly */
+	int      num_samples;
+	uint8_t  table_id;
+	int      num_sections;
+	int      len [VCT_MAX_SECTIONS];
+	uint8_t  data [VCT_MAX_SECTIONS][VCT_SECTION_SIZE];
+	int      pat_len;                 /* 0 = no PAT seen */
+	uint8_t  pat [PAT_SECTION_SIZE];
+};
+
+struct atsc_scan {
+	struct dvb_device *dev;
+	struct atsc_scan_options options;
+	struct atsc_scan_callbacks cb;
+
+	int      dmxfd;
+	uint8_t  section [MAX_SECTION_SIZE];
+
+	struct vct_capture  capture [PIPELINE_DEPTH];
+	struct atsc_channel channels [ATSC_MAX_CHANNELS];
+	int      hits [ATSC_MAX_MODULATIONS];   /* auto mode: locks per auto_modulations entry */
+
+	// -- atsc_scan_range() hand-off between the tuning thread and the worker
+	pthread_mutex_t lock;
+	pthread_cond_t  queued;
+	pthread_cond_t  freed;
+	int      head;
+	int      pending;
+	int      closing;
+	int      total;
+};
+
+
+void atsc_scan_default_options( struct atsc_scan_options *options )
+{
+	memset( options, 0, sizeof(*options) );
+
+	options->modulation         = VSB_8;
+	options->auto_modulations[0] = VSB_8;
+	options->auto_modulations[1] = QAM_256;
+	options->auto_modulations[2] = QAM_64;
+	options->num_auto_modulations = 3;
+	options->probe_ms           = 1000;
+	options->table_id           = ATSC_TVCT_TABLE_ID;
+	options->dwell_samples      = 6;
+	options->sample_interval_ms = 1000;
+	options->give_up_samples    = 3;
+	options->min_locks          = 4;
+	options->section_timeout_ms = DVB_TIMEOUT;
+	options->demux_buffer_size  = 0;
+	options->pipeline           = 1;
+}
+
+
+/*
+  ###############################################################
+  #    Open / close a scanner handle                            #
+  ###############################################################
+*/
+struct atsc_scan *atsc_scan_open_device( struct dvb_device *dev, const struct atsc_scan_options *options )
+{
+	struct dvb_frontend_info fe_info;
+	struct atsc_scan *scan;
+
+	if( dev == NULL )
+		return NULL;
+
+	if (dvb_get_info(dev, &fe_info) < 0) {
+		PERROR("ioctl FE_GET_INFO failed");
+		dvb_close( dev );
+		return NULL;
+	}
+
+	if (fe_info.type != FE_ATSC) {
+		ERROR ("frontend device is not an ATSC (VSB/QAM) device");
+		dvb_close( dev );
+		return NULL;
+	}
+
+	if( (scan = calloc( 1, sizeof(struct atsc_scan) )) == NULL )
+	{
+		dvb_close( dev );
+		return NULL;
+	}
+
+	scan->dev = dev;
+
+	if( options != NULL )
+		scan->options = *options;
+	else
+		atsc_scan_default_options( &scan->options );
+
+	// -- One demux handle for the life of the scanner; every DMX_SET_FILTER flushes it
+	if ( (scan->dmxfd = dvb_open_demux(dev)) < 0)
+	{
+		PERROR("failed opening '%s'", dev->demux_dev);
+		dvb_close( dev );
+		free( scan );
+		return NULL;
+	}
+
+	return scan;
+}
+
+struct atsc_scan *atsc_scan_open( int adapter, int frontend, int demux, int dvr, const struct atsc_scan_options *options )
+{
+	return atsc_scan_open_device( dvb_open_hw( adapter, frontend, demux, dvr ), options );
+}
+
+void atsc_scan_close( struct atsc_scan *scan )
+{
+	if( scan == NULL )
+		return;
+
+	dvb_close_fd( scan->dev, scan->dmxfd );
+	dvb_close( scan->dev );
+	free( scan );
+}
+
+void atsc_scan_set_callbacks( struct atsc_scan *scan, const struct atsc_scan_callbacks *callbacks )
+{
+	if( callbacks != NULL )
+		scan->cb = *callbacks;
+	else
+		memset( &scan->cb, 0, sizeof(scan->cb) );
+}
+
+void atsc_scan_set_options( struct atsc_scan *scan, const struct atsc_scan_options *options )
+{
+	scan->options = *options;
+	memset( scan->hits, 0, sizeof(scan->hits) );
+}
+
+struct dvb_device *atsc_scan_device( struct atsc_scan *scan )
+{
+	return scan->dev;
+}
+
+
+/*
+  ########################################################################
+  # Decode a (T)/(C)VCT section, A/65 6.3                                #
+  ########################################################################
+*/
+static void parse_sld( const uint8_t *desc, int desc_len, struct atsc_channel *channel )
+{
+	const uint8_t *el;
+	int h, number_of_elements;
+
+	if( desc_len < 3 )
+		return;
+
+	channel->has_sld = 1;
+	channel->pcr_pid = ((desc[0] & 0x1F) << 8) | desc[1];
+	number_of_elements = desc[2];
+
+	for( h = 0; h < number_of_elements && channel->num_es < ATSC_MAX_ES; h++ )
+	{
+		if( 3 + (h + 1) * SLD_ELEMENT_SIZE > desc_len )
+			break;
+
+		el = desc + 3 + h * SLD_ELEMENT_SIZE;
+
+		channel->es[channel->num_es].stream_type = el[0];
+		channel->es[channel->num_es].pid         = ((el[1] & 0x1F) << 8) | el[2];
+		memcpy( channel->es[channel->num_es].lang, &el[3], 3 );
+		channel->es[channel->num_es].lang[3]     = '\0';
+		channel->num_es++;
+	}
+}
+
+int atsc_parse_vct( const uint8_t *section, int len, struct atsc_channel *channels, int max )
+{
+	const uint8_t *p, *end, *desc, *desc_end;
+	struct atsc_channel *channel;
+	int section_length, num_channels, descr_length;
+	int i, j, n = 0;
+
+	if( len < VCT_HDR_OFFSET + VCT_CRC_SIZE )
+		return -1;
+
+	section_length = ((section[1] & 0x0F) << 8) | section[2];
+	if( section_length + 3 > len || section_length + 3 < VCT_HDR_OFFSET + VCT_CRC_SIZE )
+		return -1;
+
+	num_channels = section[9];
+	p   = section + VCT_HDR_OFFSET;
+	end = section + 3 + section_length - VCT_CRC_SIZE;
+
+	for( i = 0; i < num_channels && n < max; i++ )
+	{
+		if( p + VCT_ITEM_SIZE > end )
+			return -1;
+
+		channel = &channels[n++];
+		memset( channel, 0, sizeof(*channel) );
+
+		// -- short_name is UTF-16, keep the low byte like the old scanner did
+		for( j = 0; j < 7; j++ )
+			channel->name[j] = p[2*j + 1];
+
+		channel->table_id        = section[0];
+		channel->major           = ((p[14] & 0x0F) << 6) | ((p[15] >> 2) & 0x3F);
+		channel->minor           = ((p[15] & 0x03) << 8) | p[16];
+		channel->modulation_mode = p[17];
+		channel->tsid            = (p[22] << 8) | p[23];
+		channel->program         = (p[24] << 8) | p[25];
+		channel->service_type    = p[27] & 0x3F;
+		channel->source_id       = (p[28] << 8) | p[29];
+		descr_length             = ((p[30] & 0x03) << 8) | p[31];
+
+		desc     = p + VCT_ITEM_SIZE;
+		desc_end = desc + descr_length;
+		if( desc_end > end )
+			return -1;
+
+		/* This is IMPORTANT this stops us from trying to read the service information in a NTSC broadcast information in the VCT */
+		while( desc + 2 <= desc_end && channel->modulation_mode != ATSC_MODULATION_ANALOG )
+		{
+			if( desc + 2 + desc[1] > desc_end )
+				break;
+
+			if( desc[0] == SERVICE_LOCATION_DESCRIPTOR )
+				parse_sld( desc + 2, desc[1], channel );
+
+			desc += 2 + desc[1];
+		}
+
+		p = desc_end;
+	}
+
+	return n;
+}
+
+/* PMT PID of program in a PAT section, 0 if it is not listed */
+static uint16_t pat_pmt_pid( const uint8_t *section, int len, uint16_t program )
+{
+	const uint8_t *p, *end;
+	int section_length;
+
+	if( len < PAT_HDR_OFFSET + VCT_CRC_SIZE )
+		return 0;
+
+	section_length = ((section[1] & 0x0F) << 8) | section[2];
+	if( section_length + 3 > len )
+		return 0;
+
+	end = section + 3 + section_length - VCT_CRC_SIZE;
+
+	for( p = section + PAT_HDR_OFFSET; p + 4 <= end; p += 4 )
+	{
+		if( ((p[0] << 8) | p[1]) == program )
+			return ((p[2] & 0x1F) << 8) | p[3];
+	}
+
+	return 0;
+}
+
+
+/*
+  ###############################################################
+  #    One frontend status poll                                 #
+  ###############################################################
+*/
+static int scan_poll( struct atsc_scan *scan, struct atsc_signal *sample )
+{
+	int success = 0;
+
+	success+=dvb_read_status(scan->dev, &sample->status);
+	success+=dvb_read_signal(scan->dev, &sample->signal);
+	success+=dvb_read_snr(scan->dev, &sample->snr);
+	success+=dvb_read_ber(scan->dev, &sample->ber);
+	success+=dvb_read_unc(scan->dev, &sample->unc);
+
+	if( success != 0 )
+	{
+		PERROR("ioctl failed");
+		return -1;
+	}
+
+	return 0;
+}
+
+static void scan_record( struct atsc_scan *scan, struct vct_capture *cap, const struct atsc_signal *sample )
+{
+	if( cap->samples != NULL )
+		cap->samples[cap->num_samples++] = *sample;
+	else if( scan->cb.signal )
+		scan->cb.signal( scan->cb.user, sample );
+}
+
+
+/*
+  ###############################################################
+  #    Auto mode: find the modulation a frequency carries       #
+  ###############################################################
+*/
+static int scan_probe( struct atsc_scan *scan, uint32_t freq, enum fe_modulation *modulation )
+{
+	struct atsc_scan_options *opt = &scan->options;
+	struct dvb_frontend_parameters frontend;
+	int order[ATSC_MAX_MODULATIONS];
+	fe_status_t status, seen;
+	uint64_t deadline;
+	int i, j, num;
+
+	num = opt->num_auto_modulations;
+	if( num > ATSC_MAX_MODULATIONS )
+		num = ATSC_MAX_MODULATIONS;
+
+	// -- Most likely first: whatever locked most often on earlier frequencies, ties in list order
+	for( i = 0; i < num; i++ )
+	{
+		for( j = i; j > 0 && scan->hits[order[j-1]] < scan->hits[i]; j-- )
+			order[j] = order[j-1];
+		order[j] = i;
+	}
+
+	for( i = 0; i < num; i++ )
+	{
+		memset( &frontend, 0, sizeof(frontend) );
+		frontend.frequency = freq;
+		frontend.u.vsb.modulation = opt->auto_modulations[order[i]];
+
+		if (dvb_set_frontend(scan->dev, &frontend) < 0) {
+			PERROR("ioctl FE_SET_FRONTEND failed");
+			return -1;
+		}
+
+		// -- The demod only recovers the carrier when it is set to the right modulation,
+		// -- and that comes well before a full lock
+		seen = 0;
+		deadline = dvb_clock_us( scan->dev ) + (uint64_t) opt->probe_ms * 1000;
+
+		do
+		{
+			if( dvb_read_status( scan->dev, &status ) < 0 )
+			{
+				PERROR("ioctl FE_READ_STATUS failed");
+				return -1;
+			}
+
+			if( status & (FE_HAS_CARRIER | FE_HAS_LOCK) )
+			{
+				scan->hits[order[i]]++;
+				*modulation = opt->auto_modulations[order[i]];
+				return 1;
+			}
+
+			seen |= status;
+			dvb_sleep( scan->dev, PROBE_POLL_US );
+
+		} while( dvb_clock_us( scan->dev ) < deadline );
+
+		// -- Not even RF energy: no other modulation is going to do better
+		if( !(seen & FE_HAS_SIGNAL) )
+			break;
+	}
+
+	return 0;
+}
+
+
+/*
+  ###############################################################
+  #    Tune and watch the frontend for a stable lock            #
+  ###############################################################
+*/
+static int scan_dwell( struct atsc_scan *scan, int rf_channel, struct vct_capture *cap )
+{
+	struct atsc_frequency *summary = &cap->summary;
+	struct atsc_scan_options *opt = &scan->options;
+	struct dvb_frontend_parameters frontend;
+	struct atsc_signal sample;
+	uint32_t sum_snr = 0, sum_signal = 0;
+	int rc;
+
+	memset( summary, 0, sizeof(*summary) );
+	cap->num_samples = 0;
+	summary->rf_channel = rf_channel;
+	summary->freq       = atsc_channel_hz( rf_channel );
+	summary->modulation = opt->modulation;
+	summary->result     = ATSC_NO_LOCK;
+
+	memset( &sample, 0, sizeof(sample) );
+	sample.rf_channel = rf_channel;
+	sample.freq       = summary->freq;
+
+	if( opt->modulation == QAM_AUTO )
+	{
+		// -- Stays tuned to whatever the probe found
+		if( (rc = scan_probe( scan, summary->freq, &summary->modulation )) < 0 )
+			return -1;
+
+		if( rc == 0 )
+		{
+			// -- Nothing locked: one poll so the frequency still shows up in the signal log
+			if( scan_poll( scan, &sample ) < 0 )
+				return -1;
+
+			scan_record( scan, cap, &sample );
+			return 0;
+		}
+	}
+	else
+	{
+		memset( &frontend, 0, sizeof(frontend) );
+		frontend.frequency = summary->freq;
+		frontend.u.vsb.modulation = opt->modulation;
+
+		if (dvb_set_frontend(scan->dev, &frontend) < 0) {
+			PERROR("ioctl FE_SET_FRONTEND failed");
+			return -1;
+		}
+	}
+
+	do
+	{
+		if( scan_poll( scan, &sample ) < 0 )
+			return -1;
+
+		scan_record( scan, cap, &sample );
+
+		if( sample.status & FE_HAS_LOCK )
+		{
+			summary->errors += sample.unc;
+			summary->locks++;
+			sum_snr    += sample.snr;
+			sum_signal += sample.signal;
+		}
+
+		sample.sample++;
+
+		dvb_sleep( scan->dev, opt->sample_interval_ms * 1000 );
+
+		if( sample.sample >= opt->give_up_samples && summary->locks == 0 ) break;
+
+	} while (sample.sample < opt->dwell_samples);
+
+	if( summary->locks > 0 )
+	{
+		summary->avg_snr    = sum_snr / summary->locks;
+		summary->avg_signal = sum_signal / summary->locks;
+		summary->result     = summary->locks < opt->min_locks ? ATSC_WEAK_LOCK : ATSC_NO_VCT;
+	}
+
+	return 0;
+}
+
+
+/*
+  ###############################################################
+  #    Pull every section of the VCT off the demux              #
+  ###############################################################
+*/
+static int scan_capture( struct atsc_scan *scan, struct vct_capture *cap )
+{
+	struct dmx_sct_filter_params f;
+	uint8_t seen[VCT_MAX_SECTIONS];
+	int bytes, number, last = 0, overflows = 0;
+
+	cap->num_sections = 0;
+	cap->table_id = scan->options.table_id;
+	memset( seen, 0, sizeof(seen) );
+
+	if( scan->options.demux_buffer_size > 0 &&
+	    dvb_set_buffer_size( scan->dev, scan->dmxfd, scan->options.demux_buffer_size ) == -1 )
+		PERROR( "DMX_SET_BUFFER_SIZE" );
+
+	// -- Set Hardware to filter to only receive vct sections; 0xC8/0xFE lets both the TVCT and CVCT through
+	memset( &f, 0, sizeof(f) );
+	f.pid              = ATSC_BASE_PID;
+	f.filter.filter[0] = cap->table_id == ATSC_ANY_VCT ? ATSC_TVCT_TABLE_ID : cap->table_id;
+	f.filter.mask[0]   = cap->table_id == ATSC_ANY_VCT ? 0xFE : 0xFF;
+	f.timeout          = scan->options.section_timeout_ms;
+	f.flags            = DMX_IMMEDIATE_START | DMX_CHECK_CRC;
+
+	if (dvb_set_filter(scan->dev, scan->dmxfd, &f) == -1) {
+		PERROR("DMX_SET_FILTER");
+		return -1;
+	}
+
+	while( cap->num_sections <= last && cap->num_sections < VCT_MAX_SECTIONS )
+	{
+		bytes = dvb_read( scan->dev, scan->dmxfd, scan->section, sizeof(scan->section) );
+
+		if( DEBUG ) printf("read %d bytes\n", bytes);
+		if( DEBUG && bytes > 0 ) hex_dump(scan->section, bytes);
+
+		if( bytes < 0 )
+		{
+			// -- If error count is too high the demux overflows; try again a few times
+			if( errno == EOVERFLOW && ++overflows < MAX_OVERFLOWS )
+				continue;
+
+			break;
+		}
+
+		if( bytes < VCT_HDR_OFFSET || bytes > VCT_SECTION_SIZE )
+			continue;
+
+		// -- A mux should carry one or the other; stick to the first one seen
+		if( cap->table_id == ATSC_ANY_VCT )
+			cap->table_id = scan->section[0];
+		else if( scan->section[0] != cap->table_id )
+			continue;
+
+		number = scan->section[6];
+		last   = scan->section[7];
+
+		if( number >= VCT_MAX_SECTIONS || seen[number] )
+			continue;
+
+		seen[number] = 1;
+		memcpy( cap->data[cap->num_sections], scan->section, bytes );
+		cap->len[cap->num_sections] = bytes;
+		cap->num_sections++;
+	}
+
+	return cap->num_sections;
+}
+
+/* The VCT only names the program; the PAT says where its PMT is */
+static int scan_capture_pat( struct atsc_scan *scan, struct vct_capture *cap )
+{
+	struct dmx_sct_filter_params f;
+	int bytes, overflows = 0;
+
+	cap->pat_len = 0;
+
+	memset( &f, 0, sizeof(f) );
+	f.pid              = PAT_PID;
+	f.filter.filter[0] = PAT_TABLE_ID;
+	f.filter.mask[0]   = 0xFF;
+	f.timeout          = PAT_TIMEOUT;
+	f.flags            = DMX_IMMEDIATE_START | DMX_CHECK_CRC;
+
+	if (dvb_set_filter(scan->dev, scan->dmxfd, &f) == -1) {
+		PERROR("DMX_SET_FILTER");
+		return -1;
+	}
+
+	// -- ATSC muxes fit their PAT in one section, section 0 is all we keep
+	for( ;; )
+	{
+		bytes = dvb_read( scan->dev, scan->dmxfd, scan->section, sizeof(scan->section) );
+
+		if( bytes < 0 )
+		{
+			if( errno == EOVERFLOW && ++overflows < MAX_OVERFLOWS )
+				continue;
+
+			break;
+		}
+
+		if( bytes < PAT_HDR_OFFSET + VCT_CRC_SIZE || bytes > PAT_SECTION_SIZE || scan->section[6] != 0 )
+			continue;
+
+		memcpy( cap->pat, scan->section, bytes );
+		cap->pat_len = bytes;
+		break;
+	}
+
+	return cap->pat_len;
+}
+
+
+/*
+  ###############################################################
+  #    Decode the captured sections and report the channels     #
+  ###############################################################
+*/
+static int scan_report( struct atsc_scan *scan, struct vct_capture *cap )
+{
+	struct atsc_frequency *summary = &cap->summary;
+	int i, n, count = 0;
+
+	if( scan->cb.signal )
+	{
+		for( i = 0; i < cap->num_samples; i++ )
+			scan->cb.signal( scan->cb.user, &cap->samples[i] );
+	}
+
+	for( i = 0; i < cap->num_sections; i++ )
+	{
+		n = atsc_parse_vct( cap->data[i], cap->len[i], &scan->channels[count], ATSC_MAX_CHANNELS - count );
+		if( n > 0 )
+			count += n;
+	}
+
+	for( i = 0; i < count; i++ )
+	{
+		scan->channels[i].rf_channel = summary->rf_channel;
+		scan->channels[i].freq       = summary->freq;
+		scan->channels[i].modulation = summary->modulation;
+		scan->channels[i].pmt_pid    = pat_pmt_pid( cap->pat, cap->pat_len, scan->channels[i].program );
+
+		if( scan->cb.channel )
+			scan->cb.channel( scan->cb.user, &scan->channels[i] );
+	}
+
+	summary->num_channels = count;
+	if( cap->num_sections > 0 )
+		summary->result = ATSC_FOUND;
+
+	if( scan->cb.frequency )
+		scan->cb.frequency( scan->cb.user, summary );
+
+	return count;
+}
+
+
+/*
+  ###############################################################
+  #    Everything on one frequency that needs the frontend      #
+  ###############################################################
+*/
+static int scan_acquire( struct atsc_scan *scan, int rf_channel, struct vct_capture *cap )
+{
+	uint64_t start = dvb_clock_us( scan->dev );
+
+	cap->num_sections = 0;
+	cap->pat_len = 0;
+
+	if( scan_dwell( scan, rf_channel, cap ) < 0 )
+		return -1;
+
+	if( cap->summary.result == ATSC_NO_VCT && scan_capture( scan, cap ) < 0 )
+		return -1;
+
+	// -- Only worth the wait when there are channels to look up
+	if( cap->num_sections > 0 && scan_capture_pat( scan, cap ) < 0 )
+		return -1;
+
+	cap->summary.dwell_us = dvb_clock_us( scan->dev ) - start;
+
+	return 0;
+}
+
+
+/*###############################################################
+  #    Scan one RF channel                                      #
+  ###############################################################*/
+int atsc_scan_frequency( struct atsc_scan *scan, int rf_channel )
+{
+	struct vct_capture *cap = &scan->capture[0];
+
+	if( atsc_channel_hz( rf_channel ) == 0 )
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	cap->samples = NULL;
+
+	if( scan_acquire( scan, rf_channel, cap ) < 0 )
+		return -1;
+
+	return scan_report( scan, cap );
+}
+
+
+/*
+  ###############################################################
+  #    Worker: report captured slots in order                   #
+  ###############################################################
+*/
+static void *scan_worker( void *arg )
+{
+	struct atsc_scan *scan = arg;
+	struct vct_capture *cap;
+	int tail = 0, n;
+
+	pthread_mutex_lock( &scan->lock );
+
+	for( ;; )
+	{
+		while( scan->pending == 0 && !scan->closing )
+			pthread_cond_wait( &scan->queued, &scan->lock );
+
+		if( scan->pending == 0 )
+			break;
+
+		cap = &scan->capture[tail];
+		pthread_mutex_unlock( &scan->lock );
+
+		n = scan_report( scan, cap );
+
+		pthread_mutex_lock( &scan->lock );
+		scan->total += n;
+		scan->pending--;
+		tail = (tail + 1) % PIPELINE_DEPTH;
+		pthread_cond_signal( &scan->freed );
+	}
+
+	pthread_mutex_unlock( &scan->lock );
+
+	return NULL;
+}
+
+static int scan_range_pipelined( struct atsc_scan *scan, int first, int last )
+{
+	pthread_t worker;
+	int i, rf, rc = 0, err, started = 0;
+
+	for( i = 0; i < PIPELINE_DEPTH; i++ )
+	{
+		scan->capture[i].samples = calloc( scan->options.dwell_samples > 0 ? scan->options.dwell_samples : 1,
+						   sizeof(struct atsc_signal) );
+		if( scan->capture[i].samples == NULL )
+			rc = -1;
+	}
+
+	scan->head = scan->pending = scan->closing = scan->total = 0;
+
+	pthread_mutex_init( &scan->lock, NULL );
+	pthread_cond_init( &scan->queued, NULL );
+	pthread_cond_init( &scan->freed, NULL );
+
+	if( rc == 0 )
+	{
+		if( (err = pthread_create( &worker, NULL, scan_worker, scan )) != 0 )
+		{
+			errno = err;
+			rc = -1;
+		}
+		else
+			started = 1;
+	}
+
+	for( rf = first; rc == 0 && rf <= last; rf++ )
+	{
+		// -- Wait for a free slot; the worker only falls behind if the callbacks block
+		pthread_mutex_lock( &scan->lock );
+		while( scan->pending == PIPELINE_DEPTH )
+			pthread_cond_wait( &scan->freed, &scan->lock );
+		pthread_mutex_unlock( &scan->lock );
+
+		if( scan_acquire( scan, rf, &scan->capture[scan->head] ) < 0 )
+		{
+			rc = -1;
+			break;
+		}
+
+		pthread_mutex_lock( &scan->lock );
+		scan->head = (scan->head + 1) % PIPELINE_DEPTH;
+		scan->pending++;
+		pthread_cond_signal( &scan->queued );
+		pthread_mutex_unlock( &scan->lock );
+	}
+
+	// -- Let the worker drain whatever was captured before a failure too
+	if( started )
+	{
+		pthread_mutex_lock( &scan->lock );
+		scan->closing = 1;
+		pthread_cond_signal( &scan->queued );
+		pthread_mutex_unlock( &scan->lock );
+
+		pthread_join( worker, NULL );
+	}
+
+	pthread_cond_destroy( &scan->freed );
+	pthread_cond_destroy( &scan->queued );
+	pthread_mutex_destroy( &scan->lock );
+
+	for( i = 0; i < PIPELINE_DEPTH; i++ )
+	{
+		free( scan->capture[i].samples );
+		scan->capture[i].samples = NULL;
+	}
+
+	return rc < 0 ? -1 : scan->total;
+}
+
+/*###############################################################
+  #    Scan for valid channels in UHF band                      #
+  ###############################################################*/
+int atsc_scan_range( struct atsc_scan *scan, int first, int last )
+{
+	int rf, n, total = 0;
+
+	if( first < 2 )
+		first = 2;
+	if( last >= ATSC_NUM_CHANNELS )
+		last = ATSC_NUM_CHANNELS - 1;
+
+	if( scan->options.pipeline )
+		return scan_range_pipelined( scan, first, last );
+
+	for( rf = first; rf <= last; rf++ )
+	{
+		if( (n = atsc_scan_frequency( scan, rf )) < 0 )
+			return -1;
+
+		total += n;
+	}
+
+	return total;
+}
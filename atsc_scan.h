@@ -0,0 +1,163 @@
+#ifndef _ATSC_SCAN_H_
+#define _ATSC_SCAN_H_
+/* atsc_scan.h -- embeddable ATSC channel scanner (libatscscan.a)
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * The scan state machine behind atsc_channel_scan, without the printf()s.
+ * A struct atsc_scan owns one frontend and one demux handle that stay
+ * open across calls, and reports what it finds through callbacks:
+ *
+ *	struct atsc_scan *scan = atsc_scan_open( 0, 0, 0, 0, NULL );
+ *	struct atsc_scan_callbacks cb = { .channel = found, .user = me };
+ *
+ *	atsc_scan_set_callbacks( scan, &cb );
+ *	atsc_scan_range( scan, 14, 51 );
+ *	atsc_scan_frequency( scan, 27 );
+ *	atsc_scan_close( scan );
+ *
+ * There is no global state, so one handle per adapter may be driven
+ * from its own thread. A single handle is not safe to share between
+ * threads. atsc_scan_frequency() runs the callbacks on the calling
+ * thread. atsc_scan_range() retunes while a worker thread of its own
+ * decodes the previous frequency, so there the callbacks run on that
+ * worker, one frequency behind the tuner but in scan order, and have
+ * all finished when it returns (set options.pipeline to 0 to keep them
+ * on the caller). The structures passed to callbacks are only valid for
+ * the duration of the call.
+ *
+ * With options.modulation set to QAM_AUTO each frequency is probed with
+ * every entry of options.auto_modulations, the ones that have locked
+ * most often so far first, and the filter takes whichever of the TVCT
+ * or CVCT shows up (table_id ATSC_ANY_VCT), so one sweep finds both
+ * broadcast and cable muxes. Channels and summaries carry the
+ * modulation that actually locked.
+ */
+
+#include <stdint.h>
+#include <linux/dvb/frontend.h>
+
+#include "dvb_device.h"
+
+#define ATSC_MAX_NAME                          8
+#define ATSC_MAX_ES                           16
+#define ATSC_MAX_CHANNELS                     64  /* virtual channels per RF channel */
+
+#define ATSC_BASE_PID                     0x1FFB
+#define ATSC_TVCT_TABLE_ID                  0xC8
+#define ATSC_CVCT_TABLE_ID                  0xC9
+#define ATSC_ANY_VCT                        0x00  /* options.table_id: TVCT or CVCT, whichever comes first */
+#define ATSC_MAX_MODULATIONS                   4
+#define ATSC_MODULATION_ANALOG              0x01  /* VCT modulation_mode of an NTSC service */
+
+struct atsc_es {
+	uint16_t pid;
+	uint8_t  stream_type;
+	char     lang [4];
+};
+
+/* One virtual channel out of a VCT */
+struct atsc_channel {
+	char     name [ATSC_MAX_NAME];
+	unsigned int major;
+	unsigned int minor;
+
+	int      rf_channel;
+	uint32_t freq;
+	enum fe_modulation modulation;    /* what the frontend locked with */
+	uint8_t  table_id;                /* TVCT or CVCT */
+
+	uint8_t  modulation_mode;         /* as signalled in the VCT */
+	uint16_t tsid;
+	uint16_t program;
+	uint16_t pmt_pid;                 /* from the PAT, 0 if it was not seen */
+	uint16_t source_id;
+	uint8_t  service_type;
+
+	int      has_sld;                 /* a service location descriptor was present */
+	uint16_t pcr_pid;
+	int      num_es;
+	struct atsc_es es [ATSC_MAX_ES];
+};
+
+/* One frontend status poll while dwelling on a frequency */
+struct atsc_signal {
+	int      rf_channel;
+	uint32_t freq;
+	int      sample;
+	fe_status_t status;
+	uint16_t signal;
+	uint16_t snr;
+	uint32_t ber;
+	uint32_t unc;
+};
+
+enum atsc_result {
+	ATSC_NO_LOCK,                     /* never locked */
+	ATSC_WEAK_LOCK,                   /* locked, but not often enough to trust */
+	ATSC_NO_VCT,                      /* stable lock, no VCT within the timeout */
+	ATSC_FOUND,
+};
+
+/* What happened on one frequency, reported after its channels */
+struct atsc_frequency {
+	int      rf_channel;
+	uint32_t freq;
+	enum fe_modulation modulation;
+	enum atsc_result result;
+
+	int      locks;
+	uint32_t errors;                  /* uncorrected blocks while locked */
+	uint16_t avg_snr;
+	uint16_t avg_signal;
+	int      num_channels;
+	uint64_t dwell_us;                /* tune to result, device clock */
+};
+
+struct atsc_scan_callbacks {
+	void   (*signal)    ( void *user, const struct atsc_signal *sample );
+	void   (*channel)   ( void *user, const struct atsc_channel *channel );
+	void   (*frequency) ( void *user, const struct atsc_frequency *summary );
+	void   *user;
+};
+
+struct atsc_scan_options {
+	enum fe_modulation modulation;    /* VSB_8, QAM_AUTO = probe auto_modulations */
+	enum fe_modulation auto_modulations [ATSC_MAX_MODULATIONS]; /* VSB_8, QAM_256, QAM_64 */
+	int      num_auto_modulations;
+	unsigned probe_ms;                /* per modulation, for the carrier to come up: 1000 */
+	uint8_t  table_id;                /* ATSC_TVCT_TABLE_ID */
+	int      dwell_samples;           /* status polls per frequency: 6 */
+	unsigned sample_interval_ms;      /* between polls: 1000 */
+	int      give_up_samples;         /* stop polling after this many polls without lock: 3 */
+	int      min_locks;               /* locked polls needed to look for a VCT: 4 */
+	unsigned section_timeout_ms;      /* demux timeout per section: 9000 */
+	unsigned long demux_buffer_size;  /* 0 = driver default */
+	int      pipeline;                /* atsc_scan_range() decodes on a worker thread: 1 */
+};
+
+extern void atsc_scan_default_options( struct atsc_scan_options *options );
+
+/* Open /dev/dvb/adapterN, or wrap an already opened device (the handle
+ * takes ownership of it). options may be NULL for the defaults. */
+extern struct atsc_scan  *atsc_scan_open( int adapter, int frontend, int demux, int dvr,
+					  const struct atsc_scan_options *options );
+extern struct atsc_scan  *atsc_scan_open_device( struct dvb_device *dev,
+						 const struct atsc_scan_options *options );
+extern void               atsc_scan_close( struct atsc_scan *scan );
+
+extern void               atsc_scan_set_callbacks( struct atsc_scan *scan, const struct atsc_scan_callbacks *callbacks );
+extern void               atsc_scan_set_options( struct atsc_scan *scan, const struct atsc_scan_options *options );
+extern struct dvb_device *atsc_scan_device( struct atsc_scan *scan );
+
+/* Scan one RF channel, or first..last inclusive. Return the number of
+ * virtual channels found, -1 if the device failed. */
+extern int                atsc_scan_frequency( struct atsc_scan *scan, int rf_channel );
+extern int                atsc_scan_range( struct atsc_scan *scan, int first, int last );
+
+/* Decode one VCT section into channels[], returns how many (or -1 if
+ * the section is malformed). Exposed for tools that capture their own. */
+extern int                atsc_parse_vct( const uint8_t *section, int len, struct atsc_channel *channels, int max );
+
+
+#endif /* _ATSC_SCAN_H_ */
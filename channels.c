@@ -0,0 +1,317 @@
+/* channels.c -- load the scanner's channel list for the tools that tune
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include "common.h"
+#include "channels.h"
+
+#define CHANNEL_LINE_SIZE                    512  /* a cache entry with ATSC_MAX_ES streams runs to ~300 */
+
+static const struct {
+	const char *name;
+	enum fe_modulation value;
+} modulation_names [] = {
+	{ "8VSB", VSB_8 },
+	{ "16VSB", VSB_16 },
+	{ "QAM_64", QAM_64 },
+	{ "QAM_256", QAM_256 },
+};
+
+#define NUM_MODULATIONS (int) (sizeof(modulation_names) / sizeof(modulation_names[0]))
+
+
+const char *modulation_name( enum fe_modulation modulation )
+{
+	int i;
+
+	for( i = 0; i < NUM_MODULATIONS; i++ )
+	{
+		if( modulation_names[i].value == modulation )
+			return modulation_names[i].name;
+	}
+
+	return "UNKNOWN";
+}
+
+int modulation_from_name( const char *name, enum fe_modulation *modulation )
+{
+	int i;
+
+	for( i = 0; i < NUM_MODULATIONS; i++ )
+	{
+		if( strcmp( modulation_names[i].name, name ) == 0 )
+		{
+			*modulation = modulation_names[i].value;
+			return 0;
+		}
+	}
+
+	return -1;
+}
+
+static struct channel_entry *channels_append( struct channel_list *list )
+{
+	struct channel_entry *grown;
+
+	grown = realloc( list->entries, sizeof(struct channel_entry) * (list->count + 1) );
+	if( grown == NULL )
+		return NULL;
+
+	list->entries = grown;
+	memset( &list->entries[list->count], 0, sizeof(struct channel_entry) );
+
+	return &list->entries[list->count++];
+}
+
+
+/*###############################################################
+  #    Read back what write_channels() produced                 #
+  ###############################################################*/
+int channels_load_conf( const char *path, struct channel_list *list )
+{
+	struct channel_entry *entry;
+	char line[CHANNEL_LINE_SIZE];
+	char *field[5];
+	int lineno = 0, i;
+	unsigned long pid;
+	FILE *fp;
+
+	list->count = 0;
+	list->entries = NULL;
+
+	if( (fp = fopen( path, "r" )) == NULL )
+	{
+		PERROR( "failed opening '%s'", path );
+		return -1;
+	}
+
+	while( fgets( line, sizeof(line), fp ) != NULL )
+	{
+		lineno++;
+		line[strcspn( line, "\r\n" )] = '\0';
+
+		if( line[0] == '\0' || line[0] == '#' )
+			continue;
+
+		field[0] = strtok( line, ":" );
+		for( i = 1; i < 5; i++ )
+			field[i] = strtok( NULL, ":" );
+
+		if( field[4] == NULL || (entry = channels_append( list )) == NULL )
+		{
+			ERROR( "%s:%d: malformed channel entry", path, lineno );
+			fclose( fp );
+			channels_free( list );
+			return -1;
+		}
+
+		strncpy( entry->name, field[0], sizeof(entry->name) - 1 );
+		entry->freq = strtoul( field[1], NULL, 10 );
+
+		if( modulation_from_name( field[2], &entry->modulation ) < 0 )
+			entry->modulation = VSB_8;
+
+		for( i = 3; i < 5; i++ )
+		{
+			pid = strtoul( field[i], NULL, 10 );
+			if( pid > 0 && pid < 0x1FFF )
+				entry->pids[entry->num_pids++] = pid;
+		}
+	}
+
+	fclose( fp );
+
+	return list->count;
+}
+
+
+/*###############################################################
+  #    Read back what write_cache() produced                    #
+  ###############################################################*/
+int channels_load_cache( const char *path, struct channel_list *list )
+{
+	struct channel_entry *entry;
+	char line[CHANNEL_LINE_SIZE];
+	char *field[8], *es, *save, *pid, *type, *lang;
+	int lineno = 0, version = 1, num_fields, i;
+	FILE *fp;
+
+	list->count = 0;
+	list->entries = NULL;
+
+	if( (fp = fopen( path, "r" )) == NULL )
+	{
+		PERROR( "failed opening '%s'", path );
+		return -1;
+	}
+
+	while( fgets( line, sizeof(line), fp ) != NULL )
+	{
+		lineno++;
+		line[strcspn( line, "\r\n" )] = '\0';
+
+		if( strncmp( line, CHANNEL_CACHE_MAGIC, strlen(CHANNEL_CACHE_MAGIC) ) == 0 )
+			version = atoi( line + strlen(CHANNEL_CACHE_MAGIC) );
+
+		if( line[0] == '\0' || line[0] == '#' )
+			continue;
+
+		// -- v2 added pmt_pid after the program number
+		num_fields = version >= 2 ? 8 : 7;
+
+		field[0] = line;
+		for( i = 1; i < num_fields && field[i-1] != NULL; i++ )
+		{
+			field[i] = strchr( field[i-1], ':' );
+			if( field[i] != NULL )
+				*field[i]++ = '\0';
+		}
+
+		if( field[num_fields-1] == NULL || (entry = channels_append( list )) == NULL )
+		{
+			ERROR( "%s:%d: malformed cache entry", path, lineno );
+			fclose( fp );
+			channels_free( list );
+			return -1;
+		}
+
+		if( sscanf( field[0], "%u.%u", &entry->major, &entry->minor ) != 2 )
+			ERROR( "%s:%d: bad channel number '%s'", path, lineno, field[0] );
+
+		strncpy( entry->name, field[1], sizeof(entry->name) - 1 );
+		entry->freq    = strtoul( field[2], NULL, 10 );
+		entry->program = strtoul( field[4], NULL, 10 );
+		entry->pmt_pid = num_fields == 8 ? strtoul( field[5], NULL, 10 ) & 0x1FFF : 0;
+		entry->pcr_pid = strtoul( field[num_fields-2], NULL, 10 );
+
+		if( modulation_from_name( field[3], &entry->modulation ) < 0 )
+			entry->modulation = VSB_8;
+
+		for( es = strtok_r( field[num_fields-1], ",", &save ); es != NULL && entry->num_pids < CHANNEL_MAX_PIDS; es = strtok_r( NULL, ",", &save ) )
+		{
+			pid  = es;
+			type = strchr( pid, '/' );
+			lang = type ? strchr( type + 1, '/' ) : NULL;
+
+			if( type ) *type++ = '\0';
+			if( lang ) *lang++ = '\0';
+
+			entry->pids[entry->num_pids]  = strtoul( pid, NULL, 10 ) & 0x1FFF;
+			entry->types[entry->num_pids] = type ? strtoul( type, NULL, 0 ) : 0;
+			if( lang )
+				strncpy( entry->langs[entry->num_pids], lang, 3 );
+			entry->num_pids++;
+		}
+	}
+
+	fclose( fp );
+
+	return list->count;
+}
+
+int channels_load( const char *path, struct channel_list *list )
+{
+	char line[CHANNEL_LINE_SIZE];
+	int is_cache = 0;
+	FILE *fp;
+
+	if( (fp = fopen( path, "r" )) != NULL )
+	{
+		if( fgets( line, sizeof(line), fp ) != NULL )
+			is_cache = strncmp( line, CHANNEL_CACHE_MAGIC, strlen(CHANNEL_CACHE_MAGIC) ) == 0;
+		fclose( fp );
+	}
+
+	if( is_cache )
+		return channels_load_cache( path, list );
+
+	return channels_load_conf( path, list );
+}
+
+/*###############################################################
+  #    Write out valid Digital TV channels in a azap format     #
+  ###############################################################*/
+void channels_write_conf( FILE *fp, const struct atsc_channel *channel )
+{
+	int h, vpid = 0, apid = 0;
+
+	if( channel->modulation_mode == ATSC_MODULATION_ANALOG )
+		return;
+
+	for( h = 0; h < channel->num_es; h++ )
+	{
+		if( channel->es[h].stream_type == 0x02 && vpid == 0 )
+			vpid = channel->es[h].pid;
+		else if( channel->es[h].stream_type == 0x81 && apid == 0 )
+			apid = channel->es[h].pid;
+	}
+
+	if( channel->num_es > 1 && vpid && apid )
+		fprintf( fp, "%s:%u:%s:%d:%d\n", channel->name, channel->freq,
+			 modulation_name( channel->modulation ), vpid, apid );
+	else
+		fprintf( fp, "%s:%u:%s:0:0\n", channel->name, channel->freq,
+			 modulation_name( channel->modulation ) );
+}
+
+/*###############################################################
+  #    Write out every PID of each channel for atsc_zap et al.  #
+  ###############################################################*/
+void channels_write_cache_header( FILE *fp )
+{
+	fprintf( fp, "%s%d\n", CHANNEL_CACHE_MAGIC, CHANNEL_CACHE_VERSION );
+}
+
+void channels_write_cache( FILE *fp, const struct atsc_channel *channel )
+{
+	int h;
+
+	if( channel->modulation_mode == ATSC_MODULATION_ANALOG )
+		return;
+
+	fprintf( fp, "%u.%u:%s:%u:%s:%u:%u:%u:", channel->major, channel->minor, channel->name, channel->freq,
+		 modulation_name( channel->modulation ), channel->program, channel->pmt_pid, channel->pcr_pid );
+
+	for( h = 0; h < channel->num_es; h++ )
+		fprintf( fp, "%s%u/0x%02x/%s", h ? "," : "", channel->es[h].pid, channel->es[h].stream_type, channel->es[h].lang );
+
+	fprintf( fp, "\n" );
+}
+
+void channels_free( struct channel_list *list )
+{
+	free( list->entries );
+	list->entries = NULL;
+	list->count = 0;
+}
+
+struct channel_entry *channels_find( struct channel_list *list, const char *key )
+{
+	unsigned int major, minor;
+	char sep;
+	int i;
+
+	if( sscanf( key, "%u%c%u", &major, &sep, &minor ) == 3 && (sep == '.' || sep == '-') )
+	{
+		for( i = 0; i < list->count; i++ )
+		{
+			if( list->entries[i].major == major && list->entries[i].minor == minor )
+				return &list->entries[i];
+		}
+	}
+
+	for( i = 0; i < list->count; i++ )
+	{
+		if( strcmp( list->entries[i].name, key ) == 0 )
+			return &list->entries[i];
+	}
+
+	return NULL;
+}
@@ -0,0 +1,62 @@
+#ifndef _CHANNELS_H_
+#define _CHANNELS_H_
+/* channels.h -- load the scanner's channel list for the tools that tune
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <linux/dvb/frontend.h>
+
+#include "atsc_scan.h"
+
+#define CHANNEL_MAX_PIDS                      16
+#define CHANNEL_CACHE_MAGIC  "# atsc_channel_scan cache v"
+#define CHANNEL_CACHE_VERSION                  2  /* v1 had no pmt_pid field */
+
+struct channel_entry {
+	char     name [8];
+	unsigned int major;
+	unsigned int minor;
+	uint32_t freq;
+	enum fe_modulation modulation;
+	uint16_t program;
+	uint16_t pmt_pid;                    /* 0 if unknown */
+	uint16_t pcr_pid;
+	int      num_pids;
+	uint16_t pids [CHANNEL_MAX_PIDS];
+	uint8_t  types [CHANNEL_MAX_PIDS];   /* stream_type, 0 if unknown */
+	char     langs [CHANNEL_MAX_PIDS][4];
+};
+
+struct channel_list {
+	int      count;
+	struct channel_entry *entries;
+};
+
+/* Parse an azap style channels.conf (name:freq:modulation:vpid:apid) */
+extern int  channels_load_conf( const char *path, struct channel_list *list );
+
+/* Parse the scanner's channels.cache, one line per virtual channel:
+ * major.minor:name:freq:modulation:program:pmt_pid:pcr_pid:pid/type/lang,...
+ * v1 caches, without the pmt_pid field, still load. */
+extern int  channels_load_cache( const char *path, struct channel_list *list );
+
+/* Either of the above, picked by the cache's first line */
+extern int  channels_load( const char *path, struct channel_list *list );
+extern void channels_free( struct channel_list *list );
+
+/* Append one scanned virtual channel to either file; analog services are skipped */
+extern void channels_write_conf( FILE *fp, const struct atsc_channel *channel );
+extern void channels_write_cache_header( FILE *fp );
+extern void channels_write_cache( FILE *fp, const struct atsc_channel *channel );
+
+/* Look a channel up by major.minor (or major-minor) or name, NULL if it is not in the list */
+extern struct channel_entry *channels_find( struct channel_list *list, const char *key );
+
+extern const char *modulation_name( enum fe_modulation modulation );
+extern int         modulation_from_name( const char *name, enum fe_modulation *modulation );
+
+
+#endif /* _CHANNELS_H_ */
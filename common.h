@@ -0,0 +1,27 @@
+#ifndef _COMMON_H_
+#define _COMMON_H_
+/* common.h -- error reporting shared by the scanner, recorder and tools
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+
+#define ERROR(x...)                                                     \
+        do {                                                            \
+                fprintf(stderr, "ERROR: ");                             \
+                fprintf(stderr, x);                                     \
+                fprintf (stderr, "\n");                                 \
+        } while (0)
+
+#define PERROR(x...)                                                    \
+        do {                                                            \
+                fprintf(stderr, "ERROR: ");                             \
+                fprintf(stderr, x);                                     \
+                fprintf (stderr, " (%s)\n", strerror(errno));		\
+        } while (0)
+
+
+#endif /* _COMMON_H_ */
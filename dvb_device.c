@@ -0,0 +1,316 @@
+/* dvb_device.c -- Linux DVB API backend and the dvb_device entry points
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+
+#include "common.h"
+#include "dvb_device.h"
+
+#define TUNE_POLL_US                       10000
+
+
+/*
+  ###############################################################
+  #    Hardware backend: thin wrappers over /dev/dvb ioctls      #
+  ###############################################################
+*/
+static int hw_get_info( struct dvb_device *dev, struct dvb_frontend_info *info )
+{
+	return ioctl( dev->fe_fd, FE_GET_INFO, info );
+}
+
+static int hw_set_frontend( struct dvb_device *dev, struct dvb_frontend_parameters *frontend )
+{
+	return ioctl( dev->fe_fd, FE_SET_FRONTEND, frontend );
+}
+
+static int hw_read_status( struct dvb_device *dev, fe_status_t *status )
+{
+	return ioctl( dev->fe_fd, FE_READ_STATUS, status );
+}
+
+static int hw_read_signal( struct dvb_device *dev, uint16_t *signal )
+{
+	return ioctl( dev->fe_fd, FE_READ_SIGNAL_STRENGTH, signal );
+}
+
+static int hw_read_snr( struct dvb_device *dev, uint16_t *snr )
+{
+	return ioctl( dev->fe_fd, FE_READ_SNR, snr );
+}
+
+static int hw_read_ber( struct dvb_device *dev, uint32_t *ber )
+{
+	return ioctl( dev->fe_fd, FE_READ_BER, ber );
+}
+
+static int hw_read_unc( struct dvb_device *dev, uint32_t *unc )
+{
+	return ioctl( dev->fe_fd, FE_READ_UNCORRECTED_BLOCKS, unc );
+}
+
+static int hw_open_demux( struct dvb_device *dev )
+{
+	return open( dev->demux_dev, O_RDWR );
+}
+
+static int hw_open_dvr( struct dvb_device *dev )
+{
+	return open( dev->dvr_dev, O_RDONLY );
+}
+
+static int hw_set_buffer_size( struct dvb_device *dev, int fd, unsigned long size )
+{
+	return ioctl( fd, DMX_SET_BUFFER_SIZE, size );
+}
+
+static int hw_set_filter( struct dvb_device *dev, int fd, struct dmx_sct_filter_params *f )
+{
+	return ioctl( fd, DMX_SET_FILTER, f );
+}
+
+static int hw_set_pes_filter( struct dvb_device *dev, int fd, struct dmx_pes_filter_params *f )
+{
+	return ioctl( fd, DMX_SET_PES_FILTER, f );
+}
+
+static int hw_add_pid( struct dvb_device *dev, int fd, uint16_t pid )
+{
+	return ioctl( fd, DMX_ADD_PID, &pid );
+}
+
+static ssize_t hw_read( struct dvb_device *dev, int fd, void *buf, size_t len )
+{
+	return read( fd, buf, len );
+}
+
+static void hw_close_fd( struct dvb_device *dev, int fd )
+{
+	close( fd );
+}
+
+static void hw_sleep( struct dvb_device *dev, unsigned long usec )
+{
+	usleep( usec );
+}
+
+static uint64_t hw_clock_us( struct dvb_device *dev )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void hw_close( struct dvb_device *dev )
+{
+	if( dev->fe_fd >= 0 )
+		close( dev->fe_fd );
+}
+
+static const struct dvb_device_ops hw_ops = {
+	.name            = "hw",
+	.get_info        = hw_get_info,
+	.set_frontend    = hw_set_frontend,
+	.read_status     = hw_read_status,
+	.read_signal     = hw_read_signal,
+	.read_snr        = hw_read_snr,
+	.read_ber        = hw_read_ber,
+	.read_unc        = hw_read_unc,
+	.open_demux      = hw_open_demux,
+	.open_dvr        = hw_open_dvr,
+	.set_buffer_size = hw_set_buffer_size,
+	.set_filter      = hw_set_filter,
+	.set_pes_filter  = hw_set_pes_filter,
+	.add_pid         = hw_add_pid,
+	.read            = hw_read,
+	.close_fd        = hw_close_fd,
+	.sleep           = hw_sleep,
+	.clock_us        = hw_clock_us,
+	.close           = hw_close,
+};
+
+
+/*
+  ###############################################################
+  #    Open the real adapter's frontend                         #
+  ###############################################################
+*/
+struct dvb_device *dvb_open_hw( int adapter, int frontend, int demux, int dvr )
+{
+	struct dvb_device *dev;
+
+	dev = calloc( 1, sizeof(struct dvb_device) );
+	if( dev == NULL )
+		return NULL;
+
+	dev->ops = &hw_ops;
+
+	snprintf (dev->frontend_dev, sizeof(dev->frontend_dev),"/dev/dvb/adapter%i/frontend%i", adapter, frontend);
+	snprintf (dev->demux_dev, sizeof(dev->demux_dev), "/dev/dvb/adapter%i/demux%i", adapter, demux);
+	snprintf (dev->dvr_dev, sizeof(dev->dvr_dev), "/dev/dvb/adapter%i/dvr%i", adapter, dvr);
+
+	if ( (dev->fe_fd = open(dev->frontend_dev, O_RDWR)) < 0)
+	{
+		PERROR ("failed opening '%s'", dev->frontend_dev);
+		free( dev );
+		return NULL;
+	}
+
+	return dev;
+}
+
+void dvb_close( struct dvb_device *dev )
+{
+	if( dev == NULL )
+		return;
+
+	dev->ops->close( dev );
+	free( dev );
+}
+
+
+/*
+  ###############################################################
+  #    Dispatch to whichever backend owns the device            #
+  ###############################################################
+*/
+int dvb_get_info( struct dvb_device *dev, struct dvb_frontend_info *info )
+{
+	return dev->ops->get_info( dev, info );
+}
+
+int dvb_set_frontend( struct dvb_device *dev, struct dvb_frontend_parameters *frontend )
+{
+	return dev->ops->set_frontend( dev, frontend );
+}
+
+int dvb_read_status( struct dvb_device *dev, fe_status_t *status )
+{
+	return dev->ops->read_status( dev, status );
+}
+
+int dvb_read_signal( struct dvb_device *dev, uint16_t *signal )
+{
+	return dev->ops->read_signal( dev, signal );
+}
+
+int dvb_read_snr( struct dvb_device *dev, uint16_t *snr )
+{
+	return dev->ops->read_snr( dev, snr );
+}
+
+int dvb_read_ber( struct dvb_device *dev, uint32_t *ber )
+{
+	return dev->ops->read_ber( dev, ber );
+}
+
+int dvb_read_unc( struct dvb_device *dev, uint32_t *unc )
+{
+	return dev->ops->read_unc( dev, unc );
+}
+
+int dvb_open_demux( struct dvb_device *dev )
+{
+	return dev->ops->open_demux( dev );
+}
+
+int dvb_open_dvr( struct dvb_device *dev )
+{
+	return dev->ops->open_dvr( dev );
+}
+
+int dvb_set_buffer_size( struct dvb_device *dev, int fd, unsigned long size )
+{
+	return dev->ops->set_buffer_size( dev, fd, size );
+}
+
+int dvb_set_filter( struct dvb_device *dev, int fd, struct dmx_sct_filter_params *f )
+{
+	return dev->ops->set_filter( dev, fd, f );
+}
+
+int dvb_set_pes_filter( struct dvb_device *dev, int fd, struct dmx_pes_filter_params *f )
+{
+	return dev->ops->set_pes_filter( dev, fd, f );
+}
+
+int dvb_add_pid( struct dvb_device *dev, int fd, uint16_t pid )
+{
+	return dev->ops->add_pid( dev, fd, pid );
+}
+
+ssize_t dvb_read( struct dvb_device *dev, int fd, void *buf, size_t len )
+{
+	return dev->ops->read( dev, fd, buf, len );
+}
+
+void dvb_close_fd( struct dvb_device *dev, int fd )
+{
+	dev->ops->close_fd( dev, fd );
+}
+
+void dvb_sleep( struct dvb_device *dev, unsigned long usec )
+{
+	dev->ops->sleep( dev, usec );
+}
+
+uint64_t dvb_clock_us( struct dvb_device *dev )
+{
+	return dev->ops->clock_us( dev );
+}
+
+int dvb_wait_lock( struct dvb_device *dev, unsigned timeout_ms )
+{
+	fe_status_t status;
+	uint64_t deadline;
+
+	deadline = dvb_clock_us( dev ) + (uint64_t) timeout_ms * 1000;
+
+	do
+	{
+		if( dvb_read_status( dev, &status ) < 0 )
+		{
+			PERROR( "ioctl FE_READ_STATUS failed" );
+			return -1;
+		}
+
+		if( status & FE_HAS_LOCK )
+			return 0;
+
+		dvb_sleep( dev, TUNE_POLL_US );
+
+	} while( dvb_clock_us( dev ) < deadline );
+
+	return -1;
+}
+
+int dvb_tune( struct dvb_device *dev, uint32_t freq, enum fe_modulation modulation, unsigned timeout_ms )
+{
+	struct dvb_frontend_parameters frontend;
+
+	memset( &frontend, 0, sizeof(frontend) );
+	frontend.frequency = freq;
+	frontend.u.vsb.modulation = modulation;
+
+	if( dvb_set_frontend( dev, &frontend ) < 0 )
+	{
+		PERROR( "ioctl FE_SET_FRONTEND failed" );
+		return -1;
+	}
+
+	return dvb_wait_lock( dev, timeout_ms );
+}
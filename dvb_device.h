@@ -0,0 +1,95 @@
+#ifndef _DVB_DEVICE_H_
+#define _DVB_DEVICE_H_
+/* dvb_device.h -- frontend/demux/dvr access behind a swappable backend
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * The scanner used to issue ioctl()s straight at /dev/dvb, which meant
+ * the scan state machine could only run with a card plugged in. Every
+ * device access now goes through a dvb_device, backed either by the
+ * real adapter (dvb_open_hw) or by a scenario file (dvb_open_sim, see
+ * dvb_sim.c) so the same code can be timed and regression tested on
+ * any Linux box.
+ *
+ * Demux and dvr handles returned by dvb_open_demux()/dvb_open_dvr() are
+ * small integers that only mean something to the backend that issued
+ * them; always hand them back to the same device.
+ */
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <linux/dvb/frontend.h>
+#include <linux/dvb/dmx.h>
+
+struct dvb_device;
+
+struct dvb_device_ops {
+	const char *name;
+
+	int      (*get_info)        ( struct dvb_device *dev, struct dvb_frontend_info *info );
+	int      (*set_frontend)    ( struct dvb_device *dev, struct dvb_frontend_parameters *frontend );
+	int      (*read_status)     ( struct dvb_device *dev, fe_status_t *status );
+	int      (*read_signal)     ( struct dvb_device *dev, uint16_t *signal );
+	int      (*read_snr)        ( struct dvb_device *dev, uint16_t *snr );
+	int      (*read_ber)        ( struct dvb_device *dev, uint32_t *ber );
+	int      (*read_unc)        ( struct dvb_device *dev, uint32_t *unc );
+
+	int      (*open_demux)      ( struct dvb_device *dev );
+	int      (*open_dvr)        ( struct dvb_device *dev );
+	int      (*set_buffer_size) ( struct dvb_device *dev, int fd, unsigned long size );
+	int      (*set_filter)      ( struct dvb_device *dev, int fd, struct dmx_sct_filter_params *f );
+	int      (*set_pes_filter)  ( struct dvb_device *dev, int fd, struct dmx_pes_filter_params *f );
+	int      (*add_pid)         ( struct dvb_device *dev, int fd, uint16_t pid );
+	ssize_t  (*read)            ( struct dvb_device *dev, int fd, void *buf, size_t len );
+	void     (*close_fd)        ( struct dvb_device *dev, int fd );
+
+	void     (*sleep)           ( struct dvb_device *dev, unsigned long usec );
+	uint64_t (*clock_us)        ( struct dvb_device *dev );
+	void     (*close)           ( struct dvb_device *dev );
+};
+
+struct dvb_device {
+	const struct dvb_device_ops *ops;
+
+	char frontend_dev [80];
+	char demux_dev [80];
+	char dvr_dev [80];
+
+	int  fe_fd;
+	void *priv;
+};
+
+/* -- Backends */
+extern struct dvb_device *dvb_open_hw( int adapter, int frontend, int demux, int dvr );
+extern struct dvb_device *dvb_open_sim( const char *scenario );
+extern void               dvb_close( struct dvb_device *dev );
+
+/* -- Frontend */
+extern int      dvb_get_info( struct dvb_device *dev, struct dvb_frontend_info *info );
+extern int      dvb_set_frontend( struct dvb_device *dev, struct dvb_frontend_parameters *frontend );
+extern int      dvb_read_status( struct dvb_device *dev, fe_status_t *status );
+extern int      dvb_read_signal( struct dvb_device *dev, uint16_t *signal );
+extern int      dvb_read_snr( struct dvb_device *dev, uint16_t *snr );
+extern int      dvb_read_ber( struct dvb_device *dev, uint32_t *ber );
+extern int      dvb_read_unc( struct dvb_device *dev, uint32_t *unc );
+
+/* -- Demux / DVR */
+extern int      dvb_open_demux( struct dvb_device *dev );
+extern int      dvb_open_dvr( struct dvb_device *dev );
+extern int      dvb_set_buffer_size( struct dvb_device *dev, int fd, unsigned long size );
+extern int      dvb_set_filter( struct dvb_device *dev, int fd, struct dmx_sct_filter_params *f );
+extern int      dvb_set_pes_filter( struct dvb_device *dev, int fd, struct dmx_pes_filter_params *f );
+extern int      dvb_add_pid( struct dvb_device *dev, int fd, uint16_t pid );
+extern ssize_t  dvb_read( struct dvb_device *dev, int fd, void *buf, size_t len );
+extern void     dvb_close_fd( struct dvb_device *dev, int fd );
+
+/* -- Poll FE_READ_STATUS until FE_HAS_LOCK, -1 on timeout; dvb_tune() sets the frontend first */
+extern int      dvb_wait_lock( struct dvb_device *dev, unsigned timeout_ms );
+extern int      dvb_tune( struct dvb_device *dev, uint32_t freq, enum fe_modulation modulation, unsigned timeout_ms );
+
+/* -- Time, real or simulated */
+extern void     dvb_sleep( struct dvb_device *dev, unsigned long usec );
+extern uint64_t dvb_clock_us( struct dvb_device *dev );
+
+
+#endif /* _DVB_DEVICE_H_ */
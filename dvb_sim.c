@@ -0,0 +1,1012 @@
+/* dvb_sim.c -- simulated ATSC frontend/demux driven by a scenario file
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Lets the scanner run end to end without a card so scan time, dwell
+ * and timeout behaviour can be measured reproducibly. Time is virtual
+ * by default: sleeps and demux waits advance a clock instead of
+ * blocking, so a full 2..69 sweep finishes in milliseconds of wall time
+ * while dvb_clock_us() still reports what the sweep would have cost.
+ *
+ * Scenario format, one keyword per line, '#' starts a comment:
+ *
+ *	realtime 1                   # optional: really sleep (1 = 1x speed)
+ *	lock_delay_ms 800            # defaults for the channels that follow
+ *
+ *	channel 14                   # RF channel, starts a new block
+ *	modulation 8VSB              # only lock when tuned with one of these
+ *	lock_delay_ms 1200           # time from FE_SET_FRONTEND to FE_HAS_LOCK
+ *	signal 0:0x2000 1000:0x8000  # piecewise linear curves, ms:value
+ *	snr    0:0x0100 1500:0x0180
+ *	ber    0:0x400 2000:0
+ *	unc    0:12 2000:0
+ *	section_interval_ms 400      # repetition rate of the sections below
+ *	section 0x1ffb c8f0...       # hex section (incl. CRC) on that PID
+ *	section_file 0x1ffb tvct.bin # same, raw bytes from a file
+ *	ts capture.ts                # TS served by dvr / TS tap pes filters
+ *	bitrate 19392658             # pacing of the TS above
+ *
+ * Channels missing from the scenario never lock. Relative file names
+ * are resolved against the scenario's directory.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "common.h"
+#include "atsc_freq.h"
+#include "dvb_device.h"
+
+#define SIM_MAX_POINTS                        32
+#define SIM_MAX_SECTIONS                      16
+#define SIM_MAX_FDS                           32
+#define SIM_LINE_SIZE                       4096
+#define SIM_TS_PACKET_SIZE                   188
+#define SIM_MAX_SECTION_SIZE                4096  /* largest private section, header included */
+#define SIM_DEFAULT_LOCK_DELAY_MS            800
+#define SIM_DEFAULT_SECTION_INTERVAL_MS      400
+#define SIM_DEFAULT_BITRATE             19392658
+#define SIM_FE_LOCKED   (FE_HAS_SIGNAL | FE_HAS_CARRIER | FE_HAS_VITERBI | FE_HAS_SYNC | FE_HAS_LOCK)
+
+#define SIM_FD_SECTION                         1
+#define SIM_FD_PES                             2
+#define SIM_FD_DVR                             3
+
+struct sim_curve {
+	int      n;
+	uint32_t t_ms [SIM_MAX_POINTS];
+	uint32_t value [SIM_MAX_POINTS];
+};
+
+struct sim_section {
+	uint16_t pid;
+	int      len;
+	uint8_t  *data;
+};
+
+struct sim_channel {
+	int      rf;
+	uint32_t hz;
+	uint32_t modulations;   /* bitmask of fe_modulation, 0 = any */
+	unsigned lock_delay_ms;
+	unsigned section_interval_ms;
+	unsigned long bitrate;
+
+	struct sim_curve signal, snr, ber, unc;
+
+	int      num_sections;
+	struct sim_section sections [SIM_MAX_SECTIONS];
+
+	char     *ts_path;
+};
+
+struct sim_fd {
+	int      type;          /* 0 = free */
+	int      started;
+
+	/* -- section filter */
+	struct dmx_sct_filter_params sct;
+	int      next_section;
+	uint64_t last_us;
+
+	/* -- pes filter / dvr */
+	dmx_output_t output;
+	uint8_t  pids [8192 / 8];
+	FILE     *ts;
+	uint64_t ts_bytes;
+	uint64_t ts_start_us;
+};
+
+struct sim_state {
+	struct sim_channel *channels;
+	int      num_channels;
+
+	struct sim_channel *tuned;
+	enum fe_modulation tuned_modulation;
+	uint64_t tune_us;
+
+	uint64_t now_us;
+	double   realtime;
+
+	struct sim_fd fds [SIM_MAX_FDS];
+};
+
+
+static uint32_t crc32_table[256];
+
+static void crc32_init( void )
+{
+	uint32_t i, j, crc;
+
+	for( i = 0; i < 256; i++ )
+	{
+		crc = i << 24;
+		for( j = 0; j < 8; j++ )
+			crc = (crc & 0x80000000) ? (crc << 1) ^ 0x04C11DB7 : (crc << 1);
+		crc32_table[i] = crc;
+	}
+}
+
+/* MPEG-2 CRC, 0 over a whole section means it is intact */
+static uint32_t crc32_mpeg( const uint8_t *data, int len )
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	while( len-- > 0 )
+		crc = (crc << 8) ^ crc32_table[((crc >> 24) ^ *data++) & 0xFF];
+
+	return crc;
+}
+
+
+/*
+  ###############################################################
+  #    Virtual clock                                            #
+  ###############################################################
+*/
+static void sim_advance( struct sim_state *sim, uint64_t usec )
+{
+	sim->now_us += usec;
+
+	if( sim->realtime > 0 )
+		usleep( (useconds_t) (usec / sim->realtime) );
+}
+
+static void sim_advance_to( struct sim_state *sim, uint64_t when_us )
+{
+	if( when_us > sim->now_us )
+		sim_advance( sim, when_us - sim->now_us );
+}
+
+static int sim_locked( struct sim_state *sim )
+{
+	struct sim_channel *ch = sim->tuned;
+
+	if( ch == NULL )
+		return 0;
+
+	if( ch->modulations && !(ch->modulations & (1u << sim->tuned_modulation)) )
+		return 0;
+
+	return 1;
+}
+
+static uint64_t sim_lock_us( struct sim_state *sim )
+{
+	return sim->tune_us + (uint64_t) sim->tuned->lock_delay_ms * 1000;
+}
+
+static uint32_t sim_curve_at( struct sim_curve *c, uint32_t t_ms )
+{
+	int i;
+	double f;
+
+	if( c->n == 0 )
+		return 0;
+
+	if( t_ms <= c->t_ms[0] )
+		return c->value[0];
+
+	for( i = 1; i < c->n; i++ )
+	{
+		if( t_ms < c->t_ms[i] )
+		{
+			f = (double) (t_ms - c->t_ms[i-1]) / (c->t_ms[i] - c->t_ms[i-1]);
+			return (uint32_t) ((double) c->value[i-1] + f * ((double) c->value[i] - c->value[i-1]));
+		}
+	}
+
+	return c->value[c->n - 1];
+}
+
+static uint32_t sim_sample( struct sim_state *sim, struct sim_curve *c )
+{
+	if( sim->tuned == NULL )
+		return 0;
+
+	return sim_curve_at( c, (uint32_t) ((sim->now_us - sim->tune_us) / 1000) );
+}
+
+
+/*
+  ###############################################################
+  #    Frontend                                                 #
+  ###############################################################
+*/
+static int sim_get_info( struct dvb_device *dev, struct dvb_frontend_info *info )
+{
+	memset( info, 0, sizeof(*info) );
+	strncpy( info->name, "Simulated ATSC frontend", sizeof(info->name) - 1 );
+	info->type = FE_ATSC;
+	info->frequency_min = 54000000;
+	info->frequency_max = 858000000;
+	info->caps = FE_CAN_8VSB | FE_CAN_16VSB | FE_CAN_QAM_64 | FE_CAN_QAM_256;
+
+	return 0;
+}
+
+static int sim_set_frontend( struct dvb_device *dev, struct dvb_frontend_parameters *frontend )
+{
+	struct sim_state *sim = dev->priv;
+	int i;
+
+	sim->tuned = NULL;
+	sim->tuned_modulation = frontend->u.vsb.modulation;
+	sim->tune_us = sim->now_us;
+
+	for( i = 0; i < sim->num_channels; i++ )
+	{
+		if( sim->channels[i].hz == frontend->frequency )
+		{
+			sim->tuned = &sim->channels[i];
+			break;
+		}
+	}
+
+	return 0;
+}
+
+static int sim_read_status( struct dvb_device *dev, fe_status_t *status )
+{
+	struct sim_state *sim = dev->priv;
+
+	if( sim->tuned == NULL )
+		*status = 0;
+	else if( !sim_locked( sim ) )
+		*status = FE_HAS_SIGNAL;
+	else if( sim->now_us < sim_lock_us( sim ) )
+		*status = FE_HAS_SIGNAL | FE_HAS_CARRIER;
+	else
+		*status = SIM_FE_LOCKED;
+
+	return 0;
+}
+
+static int sim_read_signal( struct dvb_device *dev, uint16_t *signal )
+{
+	struct sim_state *sim = dev->priv;
+
+	*signal = sim->tuned ? (uint16_t) sim_sample( sim, &sim->tuned->signal ) : 0;
+	return 0;
+}
+
+static int sim_read_snr( struct dvb_device *dev, uint16_t *snr )
+{
+	struct sim_state *sim = dev->priv;
+
+	*snr = sim->tuned ? (uint16_t) sim_sample( sim, &sim->tuned->snr ) : 0;
+	return 0;
+}
+
+static int sim_read_ber( struct dvb_device *dev, uint32_t *ber )
+{
+	struct sim_state *sim = dev->priv;
+
+	*ber = sim->tuned ? sim_sample( sim, &sim->tuned->ber ) : 0;
+	return 0;
+}
+
+static int sim_read_unc( struct dvb_device *dev, uint32_t *unc )
+{
+	struct sim_state *sim = dev->priv;
+
+	*unc = sim->tuned ? sim_sample( sim, &sim->tuned->unc ) : 0;
+	return 0;
+}
+
+
+/*
+  ###############################################################
+  #    Demux / DVR                                              #
+  ###############################################################
+*/
+static struct sim_fd *sim_get_fd( struct sim_state *sim, int fd )
+{
+	if( fd < 0 || fd >= SIM_MAX_FDS || sim->fds[fd].type == 0 )
+	{
+		errno = EBADF;
+		return NULL;
+	}
+
+	return &sim->fds[fd];
+}
+
+static int sim_alloc_fd( struct sim_state *sim, int type )
+{
+	int i;
+
+	for( i = 0; i < SIM_MAX_FDS; i++ )
+	{
+		if( sim->fds[i].type == 0 )
+		{
+			memset( &sim->fds[i], 0, sizeof(struct sim_fd) );
+			sim->fds[i].type = type;
+			return i;
+		}
+	}
+
+	errno = EMFILE;
+	return -1;
+}
+
+static int sim_open_demux( struct dvb_device *dev )
+{
+	return sim_alloc_fd( dev->priv, SIM_FD_SECTION );
+}
+
+static int sim_open_dvr( struct dvb_device *dev )
+{
+	return sim_alloc_fd( dev->priv, SIM_FD_DVR );
+}
+
+static int sim_set_buffer_size( struct dvb_device *dev, int fd, unsigned long size )
+{
+	return sim_get_fd( dev->priv, fd ) ? 0 : -1;
+}
+
+static int sim_set_filter( struct dvb_device *dev, int fd, struct dmx_sct_filter_params *f )
+{
+	struct sim_state *sim = dev->priv;
+	struct sim_fd *sfd = sim_get_fd( sim, fd );
+
+	if( sfd == NULL )
+		return -1;
+
+	sfd->type         = SIM_FD_SECTION;
+	sfd->sct          = *f;
+	sfd->next_section = 0;
+	sfd->last_us      = sim->now_us;
+	sfd->started      = (f->flags & DMX_IMMEDIATE_START) != 0;
+
+	return 0;
+}
+
+static int sim_set_pes_filter( struct dvb_device *dev, int fd, struct dmx_pes_filter_params *f )
+{
+	struct sim_state *sim = dev->priv;
+	struct sim_fd *sfd = sim_get_fd( sim, fd );
+
+	if( sfd == NULL )
+		return -1;
+
+	if( f->pid > 0x2000 )
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	sfd->type    = SIM_FD_PES;
+	sfd->output  = f->output;
+	sfd->started = (f->flags & DMX_IMMEDIATE_START) != 0;
+	memset( sfd->pids, 0, sizeof(sfd->pids) );
+
+	if( f->pid == 0x2000 )
+		memset( sfd->pids, 0xFF, sizeof(sfd->pids) );
+	else
+		sfd->pids[f->pid >> 3] |= 1 << (f->pid & 7);
+
+	return 0;
+}
+
+static int sim_add_pid( struct dvb_device *dev, int fd, uint16_t pid )
+{
+	struct sim_fd *sfd = sim_get_fd( dev->priv, fd );
+
+	if( sfd == NULL )
+		return -1;
+
+	if( sfd->type != SIM_FD_PES || pid >= 0x2000 )
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	sfd->pids[pid >> 3] |= 1 << (pid & 7);
+
+	return 0;
+}
+
+/* Does the section match the demux filter? filter[0] is the table id,
+ * filter[1..] line up with section bytes 3.. (the length is skipped). */
+static int sim_section_match( struct dmx_sct_filter_params *f, struct sim_section *s )
+{
+	int i, pos;
+
+	if( s->pid != f->pid )
+		return 0;
+
+	for( i = 0; i < DMX_FILTER_SIZE; i++ )
+	{
+		pos = (i == 0) ? 0 : i + 2;
+
+		if( pos >= s->len )
+			return f->filter.mask[i] == 0;
+
+		if( (s->data[pos] ^ f->filter.filter[i]) & f->filter.mask[i] )
+			return 0;
+	}
+
+	if( (f->flags & DMX_CHECK_CRC) && crc32_mpeg( s->data, s->len ) != 0 )
+		return 0;
+
+	return 1;
+}
+
+static ssize_t sim_read_section( struct sim_state *sim, struct sim_fd *sfd, void *buf, size_t len )
+{
+	struct sim_channel *ch = sim->tuned;
+	struct sim_section *s = NULL;
+	uint64_t ready_us, deadline_us;
+	int i, n;
+
+	deadline_us = sfd->last_us + (uint64_t) sfd->sct.timeout * 1000;
+
+	if( sfd->started && sim_locked( sim ) )
+	{
+		for( i = 0; i < ch->num_sections; i++ )
+		{
+			n = (sfd->next_section + i) % ch->num_sections;
+			if( sim_section_match( &sfd->sct, &ch->sections[n] ) )
+			{
+				s = &ch->sections[n];
+				sfd->next_section = n + 1;
+				break;
+			}
+		}
+	}
+
+	if( s != NULL )
+	{
+		ready_us = sfd->last_us;
+		if( ready_us < sim_lock_us( sim ) )
+			ready_us = sim_lock_us( sim );
+		ready_us += (uint64_t) ch->section_interval_ms * 1000;
+
+		if( sfd->sct.timeout == 0 || ready_us <= deadline_us )
+		{
+			sim_advance_to( sim, ready_us );
+			sfd->last_us = sim->now_us;
+
+			if( len < (size_t) s->len )
+			{
+				errno = EOVERFLOW;
+				return -1;
+			}
+
+			memcpy( buf, s->data, s->len );
+			return s->len;
+		}
+	}
+
+	/* -- Nothing will ever show up; a real read would block forever without a timeout */
+	if( sfd->sct.timeout == 0 )
+		deadline_us = sim->now_us + 1000000;
+
+	sim_advance_to( sim, deadline_us );
+	sfd->last_us = sim->now_us;
+	errno = ETIMEDOUT;
+
+	return -1;
+}
+
+/* Is the pid routed to this reader? The dvr sees every TS_TAP pes filter. */
+static int sim_wants_pid( struct sim_state *sim, struct sim_fd *sfd, uint16_t pid )
+{
+	int i;
+
+	if( sfd->type == SIM_FD_PES )
+		return sfd->pids[pid >> 3] & (1 << (pid & 7));
+
+	for( i = 0; i < SIM_MAX_FDS; i++ )
+	{
+		if( sim->fds[i].type == SIM_FD_PES && sim->fds[i].started &&
+		    sim->fds[i].output == DMX_OUT_TS_TAP &&
+		    (sim->fds[i].pids[pid >> 3] & (1 << (pid & 7))) )
+			return 1;
+	}
+
+	return 0;
+}
+
+static ssize_t sim_read_ts( struct sim_state *sim, struct sim_fd *sfd, void *buf, size_t len )
+{
+	struct sim_channel *ch = sim->tuned;
+	uint8_t pkt[SIM_TS_PACKET_SIZE];
+	uint8_t *out = buf;
+	size_t got = 0;
+	uint16_t pid;
+	int wrapped = 0;
+
+	if( !sim_locked( sim ) || ch->ts_path == NULL )
+	{
+		sim_advance( sim, 1000000 );
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	if( sfd->ts == NULL )
+	{
+		if( (sfd->ts = fopen( ch->ts_path, "r" )) == NULL )
+			return -1;
+
+		sfd->ts_bytes = 0;
+		sfd->ts_start_us = sim->now_us > sim_lock_us( sim ) ? sim->now_us : sim_lock_us( sim );
+	}
+
+	while( got + SIM_TS_PACKET_SIZE <= len )
+	{
+		if( fread( pkt, SIM_TS_PACKET_SIZE, 1, sfd->ts ) != 1 )
+		{
+			/* -- Loop the capture, but stop if nothing in it passes the filter */
+			if( wrapped++ || sfd->ts_bytes == 0 )
+				break;
+			rewind( sfd->ts );
+			continue;
+		}
+
+		sfd->ts_bytes += SIM_TS_PACKET_SIZE;
+		pid = ((pkt[1] & 0x1F) << 8) | pkt[2];
+
+		if( !sim_wants_pid( sim, sfd, pid ) )
+			continue;
+
+		memcpy( out + got, pkt, SIM_TS_PACKET_SIZE );
+		got += SIM_TS_PACKET_SIZE;
+		wrapped = 0;
+	}
+
+	/* -- Data cannot be delivered faster than the mux carries it */
+	sim_advance_to( sim, sfd->ts_start_us + sfd->ts_bytes * 8 * 1000000 / ch->bitrate );
+
+	if( got == 0 )
+	{
+		errno = ETIMEDOUT;
+		return -1;
+	}
+
+	return got;
+}
+
+static ssize_t sim_read( struct dvb_device *dev, int fd, void *buf, size_t len )
+{
+	struct sim_state *sim = dev->priv;
+	struct sim_fd *sfd = sim_get_fd( sim, fd );
+
+	if( sfd == NULL )
+		return -1;
+
+	if( sfd->type == SIM_FD_SECTION )
+		return sim_read_section( sim, sfd, buf, len );
+
+	if( sfd->type == SIM_FD_PES && sfd->output != DMX_OUT_TSDEMUX_TAP )
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	return sim_read_ts( sim, sfd, buf, len );
+}
+
+static void sim_close_fd( struct dvb_device *dev, int fd )
+{
+	struct sim_fd *sfd = sim_get_fd( dev->priv, fd );
+
+	if( sfd == NULL )
+		return;
+
+	if( sfd->ts != NULL )
+		fclose( sfd->ts );
+
+	sfd->type = 0;
+}
+
+static void sim_sleep( struct dvb_device *dev, unsigned long usec )
+{
+	sim_advance( dev->priv, usec );
+}
+
+static uint64_t sim_clock_us( struct dvb_device *dev )
+{
+	struct sim_state *sim = dev->priv;
+
+	return sim->now_us;
+}
+
+static void sim_free( struct sim_state *sim )
+{
+	int i, j;
+
+	for( i = 0; i < SIM_MAX_FDS; i++ )
+	{
+		if( sim->fds[i].type && sim->fds[i].ts )
+			fclose( sim->fds[i].ts );
+	}
+
+	for( i = 0; i < sim->num_channels; i++ )
+	{
+		for( j = 0; j < sim->channels[i].num_sections; j++ )
+			free( sim->channels[i].sections[j].data );
+		free( sim->channels[i].ts_path );
+	}
+
+	free( sim->channels );
+	free( sim );
+}
+
+static void sim_close( struct dvb_device *dev )
+{
+	sim_free( dev->priv );
+}
+
+static const struct dvb_device_ops sim_ops = {
+	.name            = "sim",
+	.get_info        = sim_get_info,
+	.set_frontend    = sim_set_frontend,
+	.read_status     = sim_read_status,
+	.read_signal     = sim_read_signal,
+	.read_snr        = sim_read_snr,
+	.read_ber        = sim_read_ber,
+	.read_unc        = sim_read_unc,
+	.open_demux      = sim_open_demux,
+	.open_dvr        = sim_open_dvr,
+	.set_buffer_size = sim_set_buffer_size,
+	.set_filter      = sim_set_filter,
+	.set_pes_filter  = sim_set_pes_filter,
+	.add_pid         = sim_add_pid,
+	.read            = sim_read,
+	.close_fd        = sim_close_fd,
+	.sleep           = sim_sleep,
+	.clock_us        = sim_clock_us,
+	.close           = sim_close,
+};
+
+
+/*
+  ###############################################################
+  #    Scenario parser                                          #
+  ###############################################################
+*/
+static const struct {
+	const char *name;
+	enum fe_modulation value;
+} sim_modulations [] = {
+	{ "8VSB", VSB_8 },
+	{ "16VSB", VSB_16 },
+	{ "QAM_64", QAM_64 },
+	{ "QAM_256", QAM_256 },
+};
+
+static char *sim_path( const char *scenario, const char *name )
+{
+	const char *slash = strrchr( scenario, '/' );
+	char *path;
+	int dirlen;
+
+	if( name[0] == '/' || slash == NULL )
+		return strdup( name );
+
+	dirlen = slash - scenario + 1;
+	path = malloc( dirlen + strlen(name) + 1 );
+	if( path == NULL )
+		return NULL;
+
+	memcpy( path, scenario, dirlen );
+	strcpy( path + dirlen, name );
+
+	return path;
+}
+
+static int sim_parse_curve( struct sim_curve *c, char *args )
+{
+	char *tok, *colon;
+
+	c->n = 0;
+
+	for( tok = strtok( args, " \t" ); tok != NULL; tok = strtok( NULL, " \t" ) )
+	{
+		if( c->n == SIM_MAX_POINTS || (colon = strchr( tok, ':' )) == NULL )
+			return -1;
+
+		*colon = '\0';
+		c->t_ms[c->n]  = strtoul( tok, NULL, 0 );
+		c->value[c->n] = strtoul( colon + 1, NULL, 0 );
+
+		if( c->n > 0 && c->t_ms[c->n] <= c->t_ms[c->n - 1] )
+			return -1;
+
+		c->n++;
+	}
+
+	return c->n > 0 ? 0 : -1;
+}
+
+static int sim_add_section( struct sim_channel *ch, uint16_t pid, uint8_t *data, int len )
+{
+	struct sim_section *s;
+
+	if( ch->num_sections == SIM_MAX_SECTIONS || len < 3 )
+	{
+		free( data );
+		return -1;
+	}
+
+	s = &ch->sections[ch->num_sections++];
+	s->pid  = pid;
+	s->data = data;
+	s->len  = len;
+
+	return 0;
+}
+
+static int sim_parse_section( struct sim_channel *ch, char *args )
+{
+	uint8_t *data;
+	char *pid_str, *hex;
+	int len = 0, nibble = -1;
+
+	pid_str = strtok( args, " \t" );
+	hex = strtok( NULL, "" );
+	if( pid_str == NULL || hex == NULL )
+		return -1;
+
+	if( (data = malloc( strlen(hex) / 2 + 1 )) == NULL )
+		return -1;
+
+	for( ; *hex; hex++ )
+	{
+		if( isspace( (unsigned char) *hex ) )
+			continue;
+
+		if( !isxdigit( (unsigned char) *hex ) )
+		{
+			free( data );
+			return -1;
+		}
+
+		if( nibble < 0 )
+			nibble = isdigit( (unsigned char) *hex ) ? *hex - '0' : (tolower( (unsigned char) *hex ) - 'a' + 10);
+		else
+		{
+			data[len++] = (nibble << 4) | (isdigit( (unsigned char) *hex ) ? *hex - '0' : (tolower( (unsigned char) *hex ) - 'a' + 10));
+			nibble = -1;
+		}
+	}
+
+	if( nibble >= 0 )
+	{
+		free( data );
+		return -1;
+	}
+
+	return sim_add_section( ch, strtoul( pid_str, NULL, 0 ), data, len );
+}
+
+static int sim_parse_section_file( struct sim_channel *ch, const char *scenario, char *args )
+{
+	char *pid_str, *name, *path;
+	struct stat st;
+	uint8_t *data;
+	FILE *fp;
+	int len;
+
+	pid_str = strtok( args, " \t" );
+	name = strtok( NULL, " \t" );
+	if( pid_str == NULL || name == NULL || (path = sim_path( scenario, name )) == NULL )
+		return -1;
+
+	fp = fopen( path, "r" );
+	if( fp == NULL || fstat( fileno( fp ), &st ) < 0 )
+	{
+		PERROR( "failed opening '%s'", path );
+		if( fp != NULL )
+			fclose( fp );
+		free( path );
+		return -1;
+	}
+
+	if( st.st_size > SIM_MAX_SECTION_SIZE )
+	{
+		ERROR( "'%s' is %lld bytes, a section is at most %d", path, (long long) st.st_size, SIM_MAX_SECTION_SIZE );
+		fclose( fp );
+		free( path );
+		return -1;
+	}
+
+	if( (data = malloc( st.st_size > 0 ? st.st_size : 1 )) == NULL )
+	{
+		fclose( fp );
+		free( path );
+		return -1;
+	}
+
+	len = fread( data, 1, st.st_size, fp );
+	fclose( fp );
+
+	if( len != st.st_size )
+	{
+		ERROR( "short read of '%s'", path );
+		free( data );
+		free( path );
+		return -1;
+	}
+
+	free( path );
+
+	return sim_add_section( ch, strtoul( pid_str, NULL, 0 ), data, len );
+}
+
+static int sim_parse_modulation( struct sim_channel *ch, char *args )
+{
+	char *tok;
+	int i;
+
+	ch->modulations = 0;
+
+	for( tok = strtok( args, " \t" ); tok != NULL; tok = strtok( NULL, " \t" ) )
+	{
+		for( i = 0; i < (int) (sizeof(sim_modulations) / sizeof(sim_modulations[0])); i++ )
+		{
+			if( strcasecmp( tok, sim_modulations[i].name ) == 0 )
+				break;
+		}
+
+		if( i == (int) (sizeof(sim_modulations) / sizeof(sim_modulations[0])) )
+			return -1;
+
+		ch->modulations |= 1u << sim_modulations[i].value;
+	}
+
+	return 0;
+}
+
+static int sim_parse( struct sim_state *sim, const char *scenario, FILE *fp )
+{
+	struct sim_channel defaults, *ch = &defaults, *grown;
+	char line[SIM_LINE_SIZE];
+	char *key, *args, *p;
+	int lineno = 0, rc, rf;
+
+	memset( &defaults, 0, sizeof(defaults) );
+	defaults.lock_delay_ms       = SIM_DEFAULT_LOCK_DELAY_MS;
+	defaults.section_interval_ms = SIM_DEFAULT_SECTION_INTERVAL_MS;
+	defaults.bitrate             = SIM_DEFAULT_BITRATE;
+
+	while( fgets( line, sizeof(line), fp ) != NULL )
+	{
+		lineno++;
+
+		if( (p = strchr( line, '#' )) != NULL )
+			*p = '\0';
+
+		key = strtok( line, " \t\r\n" );
+		if( key == NULL )
+			continue;
+
+		args = strtok( NULL, "\r\n" );
+		if( args == NULL )
+			args = "";
+
+		rc = 0;
+
+		if( strcmp( key, "realtime" ) == 0 && ch == &defaults )
+			sim->realtime = strtod( args, NULL );
+		else if( strcmp( key, "channel" ) == 0 )
+		{
+			rf = atoi( args );
+			if( atsc_channel_hz( rf ) == 0 )
+			{
+				ERROR( "%s:%d: invalid RF channel '%s'", scenario, lineno, args );
+				return -1;
+			}
+
+			grown = realloc( sim->channels, sizeof(struct sim_channel) * (sim->num_channels + 1) );
+			if( grown == NULL )
+				return -1;
+
+			sim->channels = grown;
+			ch = &sim->channels[sim->num_channels++];
+			*ch = defaults;
+			ch->rf = rf;
+			ch->hz = atsc_channel_hz( rf );
+		}
+		else if( strcmp( key, "modulation" ) == 0 )
+			rc = sim_parse_modulation( ch, args );
+		else if( strcmp( key, "lock_delay_ms" ) == 0 )
+			ch->lock_delay_ms = strtoul( args, NULL, 0 );
+		else if( strcmp( key, "section_interval_ms" ) == 0 )
+			ch->section_interval_ms = strtoul( args, NULL, 0 );
+		else if( strcmp( key, "bitrate" ) == 0 )
+			rc = (ch->bitrate = strtoul( args, NULL, 0 )) ? 0 : -1;
+		else if( strcmp( key, "signal" ) == 0 && ch != &defaults )
+			rc = sim_parse_curve( &ch->signal, args );
+		else if( strcmp( key, "snr" ) == 0 && ch != &defaults )
+			rc = sim_parse_curve( &ch->snr, args );
+		else if( strcmp( key, "ber" ) == 0 && ch != &defaults )
+			rc = sim_parse_curve( &ch->ber, args );
+		else if( strcmp( key, "unc" ) == 0 && ch != &defaults )
+			rc = sim_parse_curve( &ch->unc, args );
+		else if( strcmp( key, "section" ) == 0 && ch != &defaults )
+			rc = sim_parse_section( ch, args );
+		else if( strcmp( key, "section_file" ) == 0 && ch != &defaults )
+			rc = sim_parse_section_file( ch, scenario, args );
+		else if( strcmp( key, "ts" ) == 0 && ch != &defaults )
+		{
+			free( ch->ts_path );
+			p = strtok( args, " \t" );
+			ch->ts_path = p ? sim_path( scenario, p ) : NULL;
+			rc = ch->ts_path ? 0 : -1;
+		}
+		else
+		{
+			ERROR( "%s:%d: unexpected '%s'", scenario, lineno, key );
+			return -1;
+		}
+
+		if( rc < 0 )
+		{
+			ERROR( "%s:%d: bad value for '%s'", scenario, lineno, key );
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+
+/*
+  ###############################################################
+  #    Open a simulated adapter from a scenario file            #
+  ###############################################################
+*/
+struct dvb_device *dvb_open_sim( const char *scenario )
+{
+	struct dvb_device *dev;
+	struct sim_state *sim;
+	FILE *fp;
+
+	if( crc32_table[1] == 0 )
+		crc32_init();
+
+	if( (fp = fopen( scenario, "r" )) == NULL )
+	{
+		PERROR( "failed opening '%s'", scenario );
+		return NULL;
+	}
+
+	dev = calloc( 1, sizeof(struct dvb_device) );
+	sim = calloc( 1, sizeof(struct sim_state) );
+	if( dev == NULL || sim == NULL )
+	{
+		free( dev );
+		free( sim );
+		fclose( fp );
+		return NULL;
+	}
+
+	if( sim_parse( sim, scenario, fp ) < 0 )
+	{
+		sim_free( sim );
+		free( dev );
+		fclose( fp );
+		return NULL;
+	}
+
+	fclose( fp );
+
+	dev->ops   = &sim_ops;
+	dev->fe_fd = -1;
+	dev->priv  = sim;
+
+	snprintf (dev->frontend_dev, sizeof(dev->frontend_dev), "sim:%s", scenario);
+	snprintf (dev->demux_dev, sizeof(dev->demux_dev), "sim:%s", scenario);
+	snprintf (dev->dvr_dev, sizeof(dev->dvr_dev), "sim:%s", scenario);
+
+	return dev;
+}
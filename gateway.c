@@ -0,0 +1,584 @@
+/* gateway.c -- stream the virtual channels of one mux as UDP/RTP
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Tunes from the scanner's channel cache, taps the whole TS from the
+ * dvr device and routes each packet by PID to one datagram stream per
+ * virtual channel. Every datagram carries 7 TS packets (1316 bytes, or
+ * 1328 with the RTP header) and datagrams are handed to the kernel in
+ * batches with sendmmsg().
+ *
+ * All buffers are sized and allocated at startup; the packet loop is a
+ * table lookup and a memcpy per packet, with one read() per dvr chunk
+ * and one sendmmsg() per stream per chunk.
+ *
+ * Stream i goes to port + i (port + 2*i with -r for RTP, leaving the odd
+ * port for RTCP). Besides the channel's own PIDs every stream carries
+ * the PAT and the PMTs it lists, so players can make sense of it.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+
+#include "common.h"
+#include "channels.h"
+#include "dvb_device.h"
+#include "ts_classify.h"
+
+#define CHANNEL_FILE "channels.cache"
+#define PAT_PID                             0x0000
+#define TS_PER_DATAGRAM                        7
+#define RTP_HEADER_SIZE                       12
+#define RTP_PT_MP2T                           33
+#define DATAGRAM_SIZE       (RTP_HEADER_SIZE + TS_PER_DATAGRAM * TS_PACKET_SIZE)
+#define BATCH_SIZE                            64  /* datagrams per sendmmsg() */
+#define DVR_READ_SIZE      (TS_PACKET_SIZE * 348)
+#define DVR_BUFFER_SIZE          (4 * 1024 * 1024)
+#define FLUSH_US                           50000  /* max age of a partly filled datagram */
+#define TUNE_TIMEOUT_MS                     5000
+#define MAX_STREAMS                           16
+
+struct stream {
+	struct channel_entry *channel;
+
+	int      sock;
+	int      hdr;           /* RTP_HEADER_SIZE or 0 */
+	uint16_t rtp_seq;
+	uint32_t rtp_ssrc;
+
+	uint8_t  *buf;          /* BATCH_SIZE datagrams */
+	struct iovec   iov [BATCH_SIZE];
+	struct mmsghdr msgs [BATCH_SIZE];
+	int      cur;           /* datagram being filled */
+	int      fill;          /* ts packets in it */
+	uint64_t pending_us;
+
+	uint64_t packets;
+	uint64_t datagrams;
+	uint64_t sends;
+	uint64_t send_errors;
+};
+
+struct gateway {
+	int      num_streams;
+	struct stream streams [MAX_STREAMS];
+
+	uint16_t route [8192];  /* bitmask of streams per PID */
+	uint16_t pat_route [8192];  /* the part of route[] that came from the current PAT */
+	uint16_t all_streams;
+	int      pat_version;
+
+	uint8_t  in [DVR_READ_SIZE + TS_PACKET_SIZE];  /* a partial packet left over, then the next read */
+	size_t   in_len;
+	struct ts_block blk;
+
+	uint64_t sync_errors;   /* bytes skipped to regain sync */
+};
+
+static volatile sig_atomic_t running = 1;
+
+
+static uint64_t now_us( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static void stop( int sig )
+{
+	running = 0;
+}
+
+
+/*###############################################################
+  #    Hand every finished datagram of a stream to the kernel   #
+  ###############################################################*/
+static void stream_close_datagram( struct stream *s, uint64_t now )
+{
+	uint8_t *d = s->buf + s->cur * DATAGRAM_SIZE;
+	uint32_t ts;
+
+	if( s->hdr )
+	{
+		ts = (uint32_t) (now * 9 / 100); /* 90 kHz */
+		d[0]  = 0x80;
+		d[1]  = RTP_PT_MP2T;
+		d[2]  = s->rtp_seq >> 8;
+		d[3]  = s->rtp_seq & 0xFF;
+		d[4]  = ts >> 24;
+		d[5]  = ts >> 16;
+		d[6]  = ts >> 8;
+		d[7]  = ts;
+		d[8]  = s->rtp_ssrc >> 24;
+		d[9]  = s->rtp_ssrc >> 16;
+		d[10] = s->rtp_ssrc >> 8;
+		d[11] = s->rtp_ssrc;
+		s->rtp_seq++;
+	}
+
+	s->iov[s->cur].iov_len = s->hdr + s->fill * TS_PACKET_SIZE;
+	s->cur++;
+	s->fill = 0;
+}
+
+static void stream_flush( struct stream *s, int partial, uint64_t now )
+{
+	int sent = 0, rc;
+
+	if( partial && s->fill > 0 )
+		stream_close_datagram( s, now );
+
+	while( sent < s->cur )
+	{
+		rc = sendmmsg( s->sock, &s->msgs[sent], s->cur - sent, 0 );
+		s->sends++;
+
+		if( rc < 0 )
+		{
+			if( errno == EINTR )
+				continue;
+
+			/* -- Nobody listening or the socket buffer is full: drop, keep the tuner moving */
+			s->send_errors += s->cur - sent;
+			break;
+		}
+
+		sent += rc;
+	}
+
+	s->datagrams += sent;
+	s->cur = 0;
+}
+
+static inline void stream_put( struct stream *s, const uint8_t *pkt, uint64_t now )
+{
+	if( s->fill == 0 )
+		s->pending_us = now;
+
+	memcpy( s->buf + s->cur * DATAGRAM_SIZE + s->hdr + s->fill * TS_PACKET_SIZE, pkt, TS_PACKET_SIZE );
+	s->packets++;
+
+	if( ++s->fill == TS_PER_DATAGRAM )
+	{
+		stream_close_datagram( s, now );
+
+		if( s->cur == BATCH_SIZE )
+			stream_flush( s, 0, now );
+	}
+}
+
+
+/*###############################################################
+  #    Route each program's PMT to every stream                 #
+  ###############################################################*/
+static void gateway_parse_pat( struct gateway *gw, const uint8_t *pkt )
+{
+	const uint8_t *sec;
+	int off = 4, len, version, i;
+	uint16_t program, pid;
+
+	if( pkt[3] & 0x20 )
+		off += 1 + pkt[4];
+	if( !(pkt[3] & 0x10) || off >= TS_PACKET_SIZE )
+		return;
+
+	off += 1 + pkt[off];  /* pointer_field */
+	if( off + 8 > TS_PACKET_SIZE )
+		return;
+
+	sec = pkt + off;
+	len = ((sec[1] & 0x0F) << 8) | sec[2];
+	version = (sec[5] >> 1) & 0x1F;
+
+	if( sec[0] != 0x00 || off + 3 + len > TS_PACKET_SIZE || version == gw->pat_version )
+		return;
+
+	gw->pat_version = version;
+
+	// -- PMTs the previous version listed are gone, unless a channel asked for the PID itself
+	for( i = 0; i < 8192; i++ )
+		gw->route[i] &= ~gw->pat_route[i];
+	memset( gw->pat_route, 0, sizeof(gw->pat_route) );
+
+	for( i = 8; i + 4 <= 3 + len - 4; i += 4 )
+	{
+		program = (sec[i] << 8) | sec[i+1];
+		pid     = ((sec[i+2] & 0x1F) << 8) | sec[i+3];
+
+		if( program != 0 )
+		{
+			gw->pat_route[pid] |= gw->all_streams & ~gw->route[pid];
+			gw->route[pid]     |= gw->all_streams;
+		}
+	}
+}
+
+/* Route what is in gw->in; the dvr is a byte stream, so a read can end
+ * inside a packet and sync can be lost, ts_classify() finds it again */
+static void gateway_feed( struct gateway *gw, uint64_t now )
+{
+	struct ts_block *blk = &gw->blk;
+	const uint8_t *pkt;
+	uint16_t pid, mask;
+	size_t pos;
+	int i, j;
+
+	for( pos = 0; gw->in_len - pos >= TS_PACKET_SIZE; pos += blk->consumed )
+	{
+		ts_classify( gw->in + pos, gw->in_len - pos, blk );
+		gw->sync_errors += blk->resync_bytes;
+
+		for( j = 0; j < blk->count; j++ )
+		{
+			pkt = gw->in + pos + blk->offset[j];
+			pid = blk->pid[j];
+
+			if( pid == PAT_PID && (blk->flags[j] & TS_F_PUSI) )
+				gateway_parse_pat( gw, pkt );
+
+			for( mask = gw->route[pid]; mask; mask &= mask - 1 )
+				stream_put( &gw->streams[__builtin_ctz( mask )], pkt, now );
+		}
+
+		if( blk->consumed == 0 )
+			break;
+	}
+
+	// -- Keep a trailing partial packet for the next read
+	memmove( gw->in, gw->in + pos, gw->in_len - pos );
+	gw->in_len -= pos;
+
+	for( i = 0; i < gw->num_streams; i++ )
+	{
+		if( gw->streams[i].cur > 0 || (gw->streams[i].fill > 0 && now - gw->streams[i].pending_us > FLUSH_US) )
+			stream_flush( &gw->streams[i], now - gw->streams[i].pending_us > FLUSH_US, now );
+	}
+}
+
+
+/*###############################################################
+  #    One connected UDP socket and one batch buffer per stream #
+  ###############################################################*/
+static int stream_open( struct stream *s, struct channel_entry *channel, struct sockaddr_in *dest, int rtp, int ttl )
+{
+	int i;
+
+	memset( s, 0, sizeof(*s) );
+	s->channel  = channel;
+	s->hdr      = rtp ? RTP_HEADER_SIZE : 0;
+	s->rtp_ssrc = (uint32_t) random();
+
+	if( (s->buf = malloc( BATCH_SIZE * DATAGRAM_SIZE )) == NULL )
+		return -1;
+
+	for( i = 0; i < BATCH_SIZE; i++ )
+	{
+		s->iov[i].iov_base = s->buf + i * DATAGRAM_SIZE;
+		s->msgs[i].msg_hdr.msg_iov = &s->iov[i];
+		s->msgs[i].msg_hdr.msg_iovlen = 1;
+	}
+
+	if( (s->sock = socket( AF_INET, SOCK_DGRAM, 0 )) < 0 )
+	{
+		PERROR( "socket" );
+		return -1;
+	}
+
+	if( IN_MULTICAST( ntohl( dest->sin_addr.s_addr ) ) &&
+	    setsockopt( s->sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl) ) < 0 )
+	{
+		PERROR( "IP_MULTICAST_TTL" );
+		return -1;
+	}
+
+	if( connect( s->sock, (struct sockaddr *) dest, sizeof(*dest) ) < 0 )
+	{
+		PERROR( "connect %s:%d", inet_ntoa( dest->sin_addr ), ntohs( dest->sin_port ) );
+		return -1;
+	}
+
+	return 0;
+}
+
+static void stream_close( struct stream *s )
+{
+	if( s->sock > 0 )
+		close( s->sock );
+	free( s->buf );
+}
+
+static int gateway_add( struct gateway *gw, struct channel_entry *channel, struct sockaddr_in *dest, int rtp, int ttl )
+{
+	struct stream *s;
+	int i;
+
+	if( gw->num_streams == MAX_STREAMS )
+	{
+		ERROR( "too many streams, at most %d", MAX_STREAMS );
+		return -1;
+	}
+
+	s = &gw->streams[gw->num_streams];
+
+	if( stream_open( s, channel, dest, rtp, ttl ) < 0 )
+		return -1;
+
+	printf( "%-8s -> udp://%s:%d%s\n", channel->name, inet_ntoa( dest->sin_addr ), ntohs( dest->sin_port ), rtp ? " (RTP)" : "" );
+
+	gw->route[PAT_PID] |= 1 << gw->num_streams;
+	for( i = 0; i < channel->num_pids; i++ )
+		gw->route[channel->pids[i]] |= 1 << gw->num_streams;
+	if( channel->pcr_pid != 0 )
+		gw->route[channel->pcr_pid] |= 1 << gw->num_streams;
+
+	gw->all_streams |= 1 << gw->num_streams;
+	gw->num_streams++;
+
+	return 0;
+}
+
+
+/*###############################################################
+  #   Display usage and exit                                    #
+  ###############################################################*/
+void usage()
+{
+     fprintf( stdout, "usage: atsc_gateway [options] <major.minor | name | frequency Hz> ...\n" );
+     fprintf( stdout, "  -a adapter        DVB adapter number [Default: 0]\n" );
+     fprintf( stdout, "  -f file           channels.cache or channels.conf [Default: %s]\n", CHANNEL_FILE );
+     fprintf( stdout, "  -d host:port      first destination [Default: 127.0.0.1:5000]\n" );
+     fprintf( stdout, "  -r                RTP instead of plain UDP\n" );
+     fprintf( stdout, "  -t ttl            multicast TTL [Default: 1]\n" );
+     fprintf( stdout, "  -n seconds        stop after this much stream time\n" );
+     fprintf( stdout, "  --sim scenario    use a simulated adapter (see dvb_sim.c)\n" );
+     exit( 0 );
+}
+
+/*###############################################################
+  #  Main program Entry                                         #
+  ###############################################################*/
+int main( int argc, char *argv[] )
+{
+	static const struct option long_opts[] = {
+		{ "sim",  required_argument, NULL, 's' },
+		{ "help", no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	struct gateway *gw;
+	struct channel_list list;
+	struct channel_entry *channel;
+	struct dvb_device *dev;
+	struct dmx_pes_filter_params pes;
+	struct sockaddr_in dest;
+	uint32_t freq = 0;
+	unsigned long mux_freq;
+	uint64_t start, wall_start, stop_us = 0, bytes = 0, now;
+	ssize_t n;
+	char *file = CHANNEL_FILE, *scenario = NULL, *host = "127.0.0.1", *colon, *end;
+	int adapter = 0, port = 5000, rtp = 0, ttl = 1, seconds = 0;
+	int dmxfd, dvrfd, c, i;
+
+	while( (c = getopt_long( argc, argv, "a:f:d:rt:n:h", long_opts, NULL )) != -1 )
+	{
+		switch( c )
+		{
+		case 'a': adapter = atoi( optarg ); break;
+		case 'f': file = optarg; break;
+		case 'd':
+			host = optarg;
+			if( (colon = strrchr( optarg, ':' )) != NULL )
+			{
+				*colon = '\0';
+				port = atoi( colon + 1 );
+			}
+			break;
+		case 'r': rtp = 1; break;
+		case 't': ttl = atoi( optarg ); break;
+		case 'n': seconds = atoi( optarg ); break;
+		case 's': scenario = optarg; break;
+		default:  usage();
+		}
+	}
+
+	if( optind == argc )
+		usage();
+
+	if( channels_load( file, &list ) < 0 )
+		return -1;
+
+	gw = calloc( 1, sizeof(struct gateway) );
+	if( gw == NULL )
+		return -1;
+
+	gw->pat_version = -1;
+	srandom( (unsigned) now_us() );
+
+	memset( &dest, 0, sizeof(dest) );
+	dest.sin_family = AF_INET;
+	if( inet_aton( host, &dest.sin_addr ) == 0 )
+	{
+		ERROR( "invalid destination '%s'", host );
+		return -1;
+	}
+
+	// -- Each argument is a channel (major.minor or name) or a whole mux by frequency
+	for( ; optind < argc; optind++ )
+	{
+		mux_freq = strtoul( argv[optind], &end, 10 );
+
+		if( *end == '\0' && mux_freq > 1000000 )
+		{
+			for( i = 0; i < list.count; i++ )
+			{
+				if( list.entries[i].freq != mux_freq )
+					continue;
+
+				dest.sin_port = htons( port + gw->num_streams * (rtp ? 2 : 1) );
+				if( gateway_add( gw, &list.entries[i], &dest, rtp, ttl ) < 0 )
+					return -1;
+			}
+			continue;
+		}
+
+		if( (channel = channels_find( &list, argv[optind] )) == NULL )
+		{
+			ERROR( "channel '%s' not found in %s", argv[optind], file );
+			return -1;
+		}
+
+		dest.sin_port = htons( port + gw->num_streams * (rtp ? 2 : 1) );
+		if( gateway_add( gw, channel, &dest, rtp, ttl ) < 0 )
+			return -1;
+	}
+
+	if( gw->num_streams == 0 )
+	{
+		ERROR( "no channels to stream" );
+		return -1;
+	}
+
+	for( i = 0; i < gw->num_streams; i++ )
+	{
+		if( freq && gw->streams[i].channel->freq != freq )
+		{
+			ERROR( "'%s' is not on the same mux as '%s'", gw->streams[i].channel->name, gw->streams[0].channel->name );
+			return -1;
+		}
+		freq = gw->streams[i].channel->freq;
+	}
+
+	if( scenario != NULL )
+		dev = dvb_open_sim( scenario );
+	else
+		dev = dvb_open_hw( adapter, 0, 0, 0 );
+
+	if( dev == NULL )
+		return -1;
+
+	printf( "Tuning to %u Hz %s\n", freq, modulation_name( gw->streams[0].channel->modulation ) );
+
+	if( dvb_tune( dev, freq, gw->streams[0].channel->modulation, TUNE_TIMEOUT_MS ) < 0 )
+	{
+		ERROR( "no lock on %u Hz", freq );
+		return -1;
+	}
+
+	// -- Tap the whole mux; PID selection is the route table above
+	if( (dmxfd = dvb_open_demux( dev )) < 0 || (dvrfd = dvb_open_dvr( dev )) < 0 )
+	{
+		PERROR( "failed opening '%s'", dev->demux_dev );
+		return -1;
+	}
+
+	// -- DMX_OUT_TS_TAP queues the mux in the dvr device, not the demux filter
+	if( dvb_set_buffer_size( dev, dvrfd, DVR_BUFFER_SIZE ) < 0 )
+		PERROR( "DMX_SET_BUFFER_SIZE on '%s'", dev->dvr_dev );
+
+	memset( &pes, 0, sizeof(pes) );
+	pes.pid      = 0x2000;
+	pes.input    = DMX_IN_FRONTEND;
+	pes.output   = DMX_OUT_TS_TAP;
+	pes.pes_type = DMX_PES_OTHER;
+	pes.flags    = DMX_IMMEDIATE_START;
+
+	if( dvb_set_pes_filter( dev, dmxfd, &pes ) < 0 )
+	{
+		PERROR( "DMX_SET_PES_FILTER" );
+		return -1;
+	}
+
+	signal( SIGINT, stop );
+	signal( SIGTERM, stop );
+
+	start = dvb_clock_us( dev );
+	wall_start = now_us();
+	if( seconds > 0 )
+		stop_us = start + (uint64_t) seconds * 1000000;
+
+	while( running && (stop_us == 0 || dvb_clock_us( dev ) < stop_us) )
+	{
+		n = dvb_read( dev, dvrfd, gw->in + gw->in_len, DVR_READ_SIZE );
+
+		if( n < 0 )
+		{
+			// -- The dvr starts over on a packet boundary, what we had of the last one is lost
+			if( errno == EOVERFLOW )
+				gw->in_len = 0;
+
+			if( errno == EINTR || errno == EOVERFLOW || errno == ETIMEDOUT )
+				continue;
+
+			PERROR( "read '%s'", dev->dvr_dev );
+			break;
+		}
+
+		bytes += n;
+		gw->in_len += n;
+		gateway_feed( gw, now_us() );
+	}
+
+	now = now_us();
+	for( i = 0; i < gw->num_streams; i++ )
+		stream_flush( &gw->streams[i], 1, now );
+
+	printf( "\n%llu bytes in %.3f s stream time, %.3f s wall time (%.1f Mbit/s)\n",
+		(unsigned long long) bytes, (dvb_clock_us( dev ) - start) / 1000000.0, (now - wall_start) / 1000000.0,
+		now > wall_start ? bytes * 8.0 / (now - wall_start) : 0.0 );
+
+	if( gw->sync_errors )
+		printf( "%llu bytes skipped to regain sync\n", (unsigned long long) gw->sync_errors );
+
+	for( i = 0; i < gw->num_streams; i++ )
+	{
+		printf( "%-8s packets %llu datagrams %llu sendmmsg %llu dropped %llu\n", gw->streams[i].channel->name,
+			(unsigned long long) gw->streams[i].packets, (unsigned long long) gw->streams[i].datagrams,
+			(unsigned long long) gw->streams[i].sends, (unsigned long long) gw->streams[i].send_errors );
+		stream_close( &gw->streams[i] );
+	}
+
+	dvb_close_fd( dev, dvrfd );
+	dvb_close_fd( dev, dmxfd );
+	dvb_close( dev );
+	channels_free( &list );
+	free( gw );
+
+	return 0;
+}
@@ -1,69 +1,396 @@
-#define GNULINUX
-#ifdef GNULINUX
-// these two definitely needed
-#define _GNU_SOURCE
-#define _FILE_OFFSET_BITS 64
-#endif
-
-// linuxthreads docs say to use this for thread-safe glibc functions
-// #define _REENTRANT // defined below
-
-#include <pthread.h>
-#include <ctype.h>
-#include <stdio.h>
+/* hdtvrec.c -- record a whole ATSC mux to disk with a packet index
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Tunes the frequency of a channel from channels.cache, takes every PID
+ * off the dvr and writes it to a file, or records whatever TS comes in
+ * on a file or stdin (-i, e.g. atsc_tap sharing an atsc_zap -D tuner).
+ *
+ * Only whole packets are written, back to back, and each of them goes
+ * through ts_classify() on the way so the sidecar index (ts_index.h)
+ * is built as the recording grows: which blocks of the file every PID
+ * is in, plus PCR and random access point positions. ts_extract uses it
+ * to pull one program or a time range back out without reading the
+ * whole mux.
+ *
+ * The disk side is ts_store.h: fixed size segments reserved up front,
+ * O_DIRECT writes and a free space check before every reservation. Each
+ * segment gets an index of its own, and the write latency and
+ * throughput of every segment are printed as it is closed.
+ */
+
+#include <sys/types.h>
 #include <unistd.h>
 #include <stdlib.h>
-
-#include <fcntl.h>
+#include <stdint.h>
 #include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
 #include <errno.h>
 #include <getopt.h>
-#include <sys/ioctl.h>
-#include <termios.h>
+#include <signal.h>
 #include <time.h>
-#include <utime.h>
-#include <sys/time.h>
-#include <sched.h>
 
-/* sqrt needs */
-#include <math.h>
+#include "common.h"
+#include "channels.h"
+#include "dvb_device.h"
+#include "ts_classify.h"
+#include "ts_index.h"
+#include "ts_store.h"
 
-/* will need for signal actions, sigterm mostly */
-#ifdef SIGNALS
-#include <signal.h>
-#endif
+#define CHANNEL_FILE "channels.cache"
+#define TUNE_TIMEOUT_MS                     5000
+#define ALL_PIDS                          0x2000
+#define READ_SIZE          (TS_PACKET_SIZE * 1024)
+#define STATS_INTERVAL_US               10000000
 
-/* statfs to get free space */
-#include <sys/vfs.h>
+struct recorder {
+	struct dvb_device *dev;           /* NULL when reading a file */
+	int      in;
+	struct ts_store *store;
+	struct ts_index_writer *index;
+	int      segment;
+	int      block_packets;
 
-/* openlog syslog closelog */
-#include <syslog.h>
+	uint8_t  buf [READ_SIZE + TS_PACKET_SIZE];
+	size_t   len;
+	struct ts_block blk;
 
+	uint64_t bytes;
+	uint64_t garbage;
+	uint64_t overflows;
+};
 
-#include <linux/videodev.h>
+static volatile sig_atomic_t running = 1;
 
-/*
-Author: Kevin Fowlks
-Purpose: Record ATSC stream to disk.
 
-Place holder for DTV recoder that handles mult channels in a TS stream.
+static void stop( int sig )
+{
+	running = 0;
+}
+
+static uint64_t now_us( struct recorder *rec )
+{
+	struct timespec ts;
 
-Plan of attack 
+	if( rec->dev != NULL )
+		return dvb_clock_us( rec->dev );
 
-Issue PID's Filter
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
-Thread 1: Writer
-	  Read data from ATSC device and write to FIFO
-	  Monitor signal power fire signal
-Thread 2: Reader
-	  Consume data from FIFO	  
-	  Sub-Thread 3
-	  Create state-machine for PISP information | Lock updates to this data so to minimze contention.	  
+/*
+  ###############################################################
+  #    Whole packets out, garbage dropped, index fed            #
+  ###############################################################
 */
+static int open_index( struct recorder *rec )
+{
+	char path[PATH_MAX + sizeof(TS_INDEX_SUFFIX)];
+
+	snprintf( path, sizeof(path), "%s%s", ts_store_path( rec->store ), TS_INDEX_SUFFIX );
+	rec->segment = ts_store_segment( rec->store );
 
-int main( int argc , char *argv[]  )
+	return (rec->index = ts_index_create( path, rec->block_packets )) != NULL ? 0 : -1;
+}
+
+static int record( struct recorder *rec )
 {
-	/* Nothing Yet */
-	
+	struct ts_block *blk = &rec->blk;
+	size_t pos, start, len;
+	int i, run, rc;
+
+	for( pos = 0; rec->len - pos >= TS_PACKET_SIZE; pos += blk->consumed )
+	{
+		// -- Never more than fits in the segment, so each block is indexed with the file it went to
+		len = rec->len - pos;
+		if( len > ts_store_room( rec->store ) )
+			len = ts_store_room( rec->store );
+
+		ts_classify( rec->buf + pos, len, blk );
+		rec->garbage += blk->resync_bytes;
+
+		// -- Packets the classifier found back to back go out in one write
+		for( i = 0; i < blk->count; i = run )
+		{
+			start = blk->offset[i];
+			for( run = i + 1; run < blk->count && blk->offset[run] == blk->offset[run - 1] + TS_PACKET_SIZE; run++ )
+				;
+
+			if( ts_store_write( rec->store, rec->buf + pos + start, (size_t) (run - i) * TS_PACKET_SIZE ) < 0 )
+				return -1;
+			rec->bytes += (uint64_t) (run - i) * TS_PACKET_SIZE;
+		}
+
+		if( ts_index_add( rec->index, blk, rec->buf + pos ) < 0 )
+			return -1;
+
+		if( ts_store_segment( rec->store ) != rec->segment )
+		{
+			rc = ts_index_close( rec->index );
+			rec->index = NULL;
+
+			if( rc < 0 || open_index( rec ) < 0 )
+				return -1;
+		}
+
+		if( blk->consumed == 0 )
+			break;
+	}
+
+	// -- Keep a trailing partial packet for the next read
+	memmove( rec->buf, rec->buf + pos, rec->len - pos );
+	rec->len -= pos;
+
 	return 0;
 }
+
+static void on_segment( void *user, const struct ts_store_stats *st )
+{
+	static const char *modes[] = { "direct", "sync_file_range", "buffered" };
+	double secs = (st->end_us - st->start_us) / 1e6;
+
+	printf( "%s: %.1f MB in %.1f s, %.1f MB/s (%s%s)\n", st->path, st->bytes / 1e6, secs,
+		secs > 0 ? st->bytes / 1e6 / secs : 0, modes[st->mode], st->preallocated ? ", preallocated" : "" );
+	printf( "  %llu writes, latency avg %.2f ms, p99 < %.1f ms, max %.2f ms, %.1f MB/s while writing\n",
+		(unsigned long long) st->writes, st->writes ? st->write_us / 1e3 / st->writes : 0,
+		ts_store_percentile( st, 99 ) / 1e3, st->max_us / 1e3,
+		st->write_us ? (double) st->bytes / st->write_us : 0 );
+	printf( "  %.1f GB free%s\n", st->free_bytes / 1e9, st->removed ? ", removed old segments to make room" : "" );
+}
+
+static void print_stats( struct recorder *rec )
+{
+	printf( "%llu bytes, %llu packets indexed, %llu garbage bytes, %llu dvr overflows\n",
+		(unsigned long long) rec->bytes, (unsigned long long) (rec->index ? ts_index_packets( rec->index ) : 0),
+		(unsigned long long) rec->garbage, (unsigned long long) rec->overflows );
+}
+
+/*
+  ###############################################################
+  #    Tune the whole mux a channel is on                       #
+  ###############################################################
+*/
+static int tune( struct recorder *rec, struct channel_entry *channel, int *filter )
+{
+	struct dmx_pes_filter_params pes;
+
+	printf( "%u.%u %s: recording the whole mux at %u Hz %s\n", channel->major, channel->minor,
+		channel->name, channel->freq, modulation_name( channel->modulation ) );
+
+	if( dvb_tune( rec->dev, channel->freq, channel->modulation, TUNE_TIMEOUT_MS ) < 0 )
+	{
+		ERROR( "no lock on %u Hz", channel->freq );
+		return -1;
+	}
+
+	if( (*filter = dvb_open_demux( rec->dev )) < 0 )
+	{
+		PERROR( "failed opening '%s'", rec->dev->demux_dev );
+		return -1;
+	}
+
+	memset( &pes, 0, sizeof(pes) );
+	pes.pid      = ALL_PIDS;
+	pes.input    = DMX_IN_FRONTEND;
+	pes.output   = DMX_OUT_TS_TAP;
+	pes.pes_type = DMX_PES_OTHER;
+	pes.flags    = DMX_IMMEDIATE_START;
+
+	if( dvb_set_pes_filter( rec->dev, *filter, &pes ) < 0 )
+	{
+		PERROR( "DMX_SET_PES_FILTER pid 0x%x", ALL_PIDS );
+		return -1;
+	}
+
+	if( (rec->in = dvb_open_dvr( rec->dev )) < 0 )
+	{
+		PERROR( "failed opening '%s'", rec->dev->dvr_dev );
+		return -1;
+	}
+
+	return 0;
+}
+
+/*###############################################################
+  #   Display usage and exit                                    #
+  ###############################################################*/
+void usage()
+{
+     fprintf( stdout, "usage: hdtvrecorder [options] <major.minor | name> output.ts\n" );
+     fprintf( stdout, "       hdtvrecorder [options] -i input output.ts\n" );
+     fprintf( stdout, "  -a adapter        DVB adapter number [Default: 0]\n" );
+     fprintf( stdout, "  -f file           scan cache [Default: %s]\n", CHANNEL_FILE );
+     fprintf( stdout, "  -i file           record a TS file or - (stdin) instead of tuning\n" );
+     fprintf( stdout, "  -n seconds        stop after this long\n" );
+     fprintf( stdout, "  -B packets        index block size [Default: %d]\n", TS_INDEX_BLOCK_PACKETS );
+     fprintf( stdout, "  -S MB             segment size, 0 for one file [Default: 1024]\n" );
+     fprintf( stdout, "  -W mode           direct, range (sync_file_range) or buffered [Default: direct]\n" );
+     fprintf( stdout, "  -m MB             free space to leave on the disk [Default: 512]\n" );
+     fprintf( stdout, "  -R                delete the oldest segment when space runs low instead of stopping\n" );
+     fprintf( stdout, "  --sim scenario    use a simulated adapter (see dvb_sim.c)\n" );
+     exit( 0 );
+}
+
+/*###############################################################
+  #  Main program Entry                                         #
+  ###############################################################*/
+int main( int argc, char *argv[] )
+{
+	static const struct option long_opts[] = {
+		{ "sim",  required_argument, NULL, 's' },
+		{ "help", no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	static struct recorder rec;
+	struct channel_list list;
+	struct channel_entry *channel;
+	struct ts_store_options store;
+	char *file = CHANNEL_FILE, *scenario = NULL, *input = NULL, *output;
+	uint64_t start, end = 0, last_stats;
+	ssize_t n;
+	int adapter = 0, seconds = 0;
+	int filter = -1, c, rc = 0;
+
+	memset( &list, 0, sizeof(list) );
+	ts_store_default_options( &store );
+	store.sidecar      = TS_INDEX_SUFFIX;
+	store.segment_done = on_segment;
+	rec.block_packets  = TS_INDEX_BLOCK_PACKETS;
+
+	while( (c = getopt_long( argc, argv, "a:f:i:n:B:S:W:m:Rh", long_opts, NULL )) != -1 )
+	{
+		switch( c )
+		{
+		case 'a': adapter = atoi( optarg ); break;
+		case 'f': file = optarg; break;
+		case 'i': input = optarg; break;
+		case 'n': seconds = atoi( optarg ); break;
+		case 'B': rec.block_packets = atoi( optarg ); break;
+		case 'S': store.segment_size = strtoull( optarg, NULL, 0 ) * 1024 * 1024; break;
+		case 'W':
+			if( strcmp( optarg, "direct" ) == 0 )
+				store.mode = TS_STORE_DIRECT;
+			else if( strcmp( optarg, "range" ) == 0 )
+				store.mode = TS_STORE_SYNC_RANGE;
+			else if( strcmp( optarg, "buffered" ) == 0 )
+				store.mode = TS_STORE_BUFFERED;
+			else
+				usage();
+			break;
+		case 'm': store.min_free = strtoull( optarg, NULL, 0 ) * 1024 * 1024; break;
+		case 'R': store.rotate = 1; break;
+		case 's': scenario = optarg; break;
+		default:  usage();
+		}
+	}
+
+	if( optind != argc - (input != NULL ? 1 : 2) || rec.block_packets <= 0 )
+		usage();
+
+	output = argv[argc - 1];
+	rec.in = -1;
+
+	if( input != NULL )
+	{
+		if( strcmp( input, "-" ) == 0 )
+			rec.in = STDIN_FILENO;
+		else if( (rec.in = open( input, O_RDONLY )) < 0 )
+		{
+			PERROR( "failed opening '%s'", input );
+			return -1;
+		}
+	}
+	else
+	{
+		if( channels_load( file, &list ) < 0 )
+			return -1;
+
+		if( (channel = channels_find( &list, argv[optind] )) == NULL )
+		{
+			ERROR( "channel '%s' not found in %s", argv[optind], file );
+			return -1;
+		}
+
+		if( scenario != NULL )
+			rec.dev = dvb_open_sim( scenario );
+		else
+			rec.dev = dvb_open_hw( adapter, 0, 0, 0 );
+
+		if( rec.dev == NULL || tune( &rec, channel, &filter ) < 0 )
+			return -1;
+	}
+
+	if( (rec.store = ts_store_open( output, &store )) == NULL || open_index( &rec ) < 0 )
+		return -1;
+
+	signal( SIGINT, stop );
+	signal( SIGTERM, stop );
+
+	printf( "Recording to '%s'%s\n", ts_store_path( rec.store ), seconds > 0 ? "" : ", Ctrl-C to stop" );
+
+	start = last_stats = now_us( &rec );
+	if( seconds > 0 )
+		end = start + (uint64_t) seconds * 1000000;
+
+	while( running && (end == 0 || now_us( &rec ) < end) )
+	{
+		if( rec.dev != NULL )
+			n = dvb_read( rec.dev, rec.in, rec.buf + rec.len, READ_SIZE + TS_PACKET_SIZE - rec.len );
+		else
+			n = read( rec.in, rec.buf + rec.len, READ_SIZE + TS_PACKET_SIZE - rec.len );
+
+		if( n < 0 )
+		{
+			if( errno == EOVERFLOW )
+				rec.overflows++;
+			else if( errno != EINTR && errno != EAGAIN )
+			{
+				PERROR( "read of input failed" );
+				rc = -1;
+				break;
+			}
+			continue;
+		}
+
+		if( n == 0 )
+			break;
+
+		rec.len += n;
+
+		if( record( &rec ) < 0 )
+		{
+			rc = -1;
+			break;
+		}
+
+		if( now_us( &rec ) - last_stats >= STATS_INTERVAL_US )
+		{
+			print_stats( &rec );
+			last_stats = now_us( &rec );
+		}
+	}
+
+	print_stats( &rec );
+	printf( "%.1f s recorded\n", (now_us( &rec ) - start) / 1000000.0 );
+
+	if( ts_index_close( rec.index ) < 0 )
+		rc = -1;
+
+	if( ts_store_close( rec.store ) < 0 )
+		rc = -1;
+
+	if( rec.dev != NULL )
+	{
+		dvb_close_fd( rec.dev, rec.in );
+		dvb_close_fd( rec.dev, filter );
+		dvb_close( rec.dev );
+		channels_free( &list );
+	}
+	else if( rec.in != STDIN_FILENO )
+		close( rec.in );
+
+	return rc;
+}
@@ -0,0 +1,143 @@
+/* tap.c -- follow the TS served by atsc_zap -D
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Attaches to the tuner daemon's shared memory ring and writes what it
+ * sees to a file, FIFO or stdout, straight from the mapping. By default
+ * the daemon laps us if we fall behind and we count what was lost; with
+ * -b it waits for us instead (up to its -w limit).
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+
+#include "common.h"
+#include "ts_ring.h"
+
+#define WAIT_MS                             1000
+#define CHUNK_SIZE                  (188 * 4096)  /* released after each, so a blocking tap holds the daemon up briefly */
+
+static volatile sig_atomic_t running = 1;
+
+
+static void stop( int sig )
+{
+	running = 0;
+}
+
+/*###############################################################
+  #   Display usage and exit                                    #
+  ###############################################################*/
+void usage()
+{
+     fprintf( stdout, "usage: atsc_tap [options] socket\n" );
+     fprintf( stdout, "  -o file           where the TS goes [Default: stdout]\n" );
+     fprintf( stdout, "  -b                backpressure: the daemon waits for us instead of lapping us\n" );
+     fprintf( stdout, "  -n seconds        stop after this long\n" );
+     exit( 0 );
+}
+
+/*###############################################################
+  #  Main program Entry                                         #
+  ###############################################################*/
+int main( int argc, char *argv[] )
+{
+	struct ts_ring *ring;
+	const uint8_t *p;
+	enum ts_ring_policy policy = TS_RING_DROP;
+	uint64_t cur, dropped = 0, torn = 0, bytes = 0;
+	time_t end = 0;
+	char *output = NULL;
+	ssize_t rc;
+	size_t n, done;
+	int seconds = 0, out = STDOUT_FILENO, c;
+
+	while( (c = getopt( argc, argv, "o:bn:h" )) != -1 )
+	{
+		switch( c )
+		{
+		case 'o': output = optarg; break;
+		case 'b': policy = TS_RING_BLOCK; break;
+		case 'n': seconds = atoi( optarg ); break;
+		default:  usage();
+		}
+	}
+
+	if( optind != argc - 1 )
+		usage();
+
+	if( output != NULL && (out = open( output, O_WRONLY | O_CREAT | O_TRUNC, 0644 )) < 0 )
+	{
+		PERROR( "failed opening '%s'", output );
+		return -1;
+	}
+
+	if( (ring = ts_ring_connect( argv[optind], policy )) == NULL )
+		return -1;
+
+	signal( SIGINT, stop );
+	signal( SIGTERM, stop );
+	signal( SIGPIPE, SIG_IGN );
+
+	if( seconds > 0 )
+	{
+		end = time( NULL ) + seconds;
+		alarm( seconds + 1 );
+		signal( SIGALRM, stop );
+	}
+
+	cur = ts_ring_head( ring );
+
+	while( running && ts_ring_wait( ring, cur, WAIT_MS ) >= 0 )
+	{
+		while( running && (n = ts_ring_peek( ring, &cur, &p, &dropped )) > 0 )
+		{
+			if( end != 0 && time( NULL ) >= end )
+				running = 0;
+
+			if( n > CHUNK_SIZE )
+				n = CHUNK_SIZE;
+
+			for( done = 0; done < n; done += rc )
+			{
+				if( (rc = write( out, p + done, n - done )) < 0 )
+				{
+					if( errno == EINTR )
+					{
+						rc = 0;
+						continue;
+					}
+					PERROR( "write" );
+					running = 0;
+					break;
+				}
+			}
+
+			// -- Overwritten under us: what went out is garbage, count it as lost
+			if( ts_ring_check( ring, cur, n ) < 0 )
+				torn += n;
+
+			bytes += n;
+			cur   += n;
+			ts_ring_release( ring, cur );
+		}
+	}
+
+	fprintf( stderr, "%llu bytes, %llu dropped, %llu overwritten while writing\n",
+		 (unsigned long long) bytes, (unsigned long long) dropped, (unsigned long long) torn );
+
+	ts_ring_close( ring );
+	if( out != STDOUT_FILENO )
+		close( out );
+
+	return 0;
+}
@@ -0,0 +1,260 @@
+/* ts_bench.c -- packets per second of each ts_classify() kernel
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Classifies a capture (or a generated mux with PCRs, adaptation
+ * fields and the odd burst of garbage) with every kernel the CPU
+ * supports, checks they agree and prints their throughput against the
+ * scalar one.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <time.h>
+
+#include "common.h"
+#include "ts_classify.h"
+
+#define DEFAULT_PACKETS                   500000
+#define DEFAULT_ROUNDS                         5
+
+struct result {
+	uint64_t packets;
+	uint64_t resync_bytes;
+	uint64_t pcrs;
+	uint32_t sum;
+};
+
+static uint64_t now_us( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+  ###############################################################
+  #    Synthetic mux: video with PCR/RAI, audio, PSI, stuffing  #
+  ###############################################################
+*/
+static uint8_t *generate( int packets, int corrupt_every, size_t *len )
+{
+	static const uint16_t pids[] = { 0x31, 0x31, 0x31, 0x31, 0x34, 0x30, 0x00, 0x1FFB, 0x1FFF };
+	uint8_t cc[0x2000], *buf, *p;
+	size_t size;
+	int i, pid, junk;
+
+	size = (size_t) packets * TS_PACKET_SIZE + (corrupt_every ? (size_t) (packets / corrupt_every + 1) * TS_PACKET_SIZE : 0);
+	if( (buf = malloc( size )) == NULL )
+		return NULL;
+
+	memset( cc, 0, sizeof(cc) );
+	srand( 1 );
+	p = buf;
+
+	for( i = 0; i < packets; i++ )
+	{
+		pid = pids[rand() % (sizeof(pids) / sizeof(pids[0]))];
+
+		memset( p, 0xFF, TS_PACKET_SIZE );
+		p[0] = TS_SYNC_BYTE;
+		p[1] = (pid >> 8) | ((rand() % 8 == 0) ? 0x40 : 0);
+		p[2] = pid & 0xFF;
+		p[3] = 0x10 | cc[pid];
+		cc[pid] = (cc[pid] + 1) & 0x0F;
+
+		if( pid == 0x31 && rand() % 4 == 0 )
+		{
+			// -- PCR, sometimes on a random access point
+			p[3] |= 0x20;
+			p[4] = 7;
+			p[5] = 0x10 | ((rand() % 8 == 0) ? 0x40 : 0);
+			p[6] = rand(); p[7] = rand(); p[8] = rand(); p[9] = rand(); p[10] = 0x7E; p[11] = rand();
+		}
+		else if( rand() % 16 == 0 )
+		{
+			// -- Stuffing, or an adaptation field only packet
+			p[3] |= 0x20;
+			p[4] = rand() % 2 ? rand() % 180 : 183;
+			p[5] = 0;
+			if( p[4] == 183 )
+				p[3] &= ~0x10;
+		}
+
+		p += TS_PACKET_SIZE;
+
+		if( corrupt_every && i % corrupt_every == corrupt_every - 1 )
+		{
+			junk = 1 + rand() % (TS_PACKET_SIZE - 1);
+			memset( p, 0xA5, junk );
+			p += junk;
+		}
+	}
+
+	*len = p - buf;
+	return buf;
+}
+
+static uint8_t *load( const char *path, size_t *len )
+{
+	struct stat st;
+	uint8_t *buf;
+	ssize_t n;
+	size_t got = 0;
+	int fd;
+
+	if( (fd = open( path, O_RDONLY )) < 0 || fstat( fd, &st ) < 0 )
+	{
+		PERROR( "failed opening '%s'", path );
+		return NULL;
+	}
+
+	if( (buf = malloc( st.st_size )) == NULL )
+		return NULL;
+
+	while( got < st.st_size && (n = read( fd, buf + got, st.st_size - got )) > 0 )
+		got += n;
+
+	close( fd );
+	*len = got;
+	return buf;
+}
+
+/*
+  ###############################################################
+  #    One pass over the buffer, folding the output in a sum    #
+  ###############################################################
+*/
+static void run( const uint8_t *buf, size_t len, struct ts_block *blk, struct result *r )
+{
+	size_t pos = 0;
+	uint32_t sum = 2166136261u;
+	int i;
+
+	memset( r, 0, sizeof(*r) );
+
+	while( len - pos >= TS_PACKET_SIZE )
+	{
+		ts_classify( buf + pos, len - pos, blk );
+
+		for( i = 0; i < blk->count; i++ )
+		{
+			sum = (sum ^ (blk->pid[i] | (blk->flags[i] << 16))) * 16777619u;
+			sum = (sum ^ (blk->cc[i] | (blk->payload[i] << 8) | (blk->offset[i] << 16))) * 16777619u;
+			if( blk->flags[i] & TS_F_PCR )
+				r->pcrs++;
+		}
+
+		r->packets += blk->count;
+		r->resync_bytes += blk->resync_bytes;
+		pos += blk->consumed;
+	}
+
+	r->sum = sum;
+}
+
+/*###############################################################
+  #   Display usage and exit                                    #
+  ###############################################################*/
+void usage()
+{
+     fprintf( stdout, "usage: ts_bench [options] [capture.ts]\n" );
+     fprintf( stdout, "  -n packets        size of the generated mux [Default: %d]\n", DEFAULT_PACKETS );
+     fprintf( stdout, "  -e every          insert garbage after every Nth packet [Default: none]\n" );
+     fprintf( stdout, "  -r rounds         passes per kernel, best one counts [Default: %d]\n", DEFAULT_ROUNDS );
+     exit( 0 );
+}
+
+/*###############################################################
+  #  Main program Entry                                         #
+  ###############################################################*/
+int main( int argc, char *argv[] )
+{
+	static const struct { enum ts_classify_impl impl; const char *name; } impls[] = {
+		{ TS_IMPL_SCALAR, "scalar" },
+		{ TS_IMPL_SSE2,   "sse2" },
+		{ TS_IMPL_AVX2,   "avx2" },
+	};
+
+	static struct ts_block blk;
+	struct result r, ref = { 0 };
+	uint64_t t, best;
+	double scalar_pps = 0, pps;
+	uint8_t *buf;
+	size_t len;
+	int packets = DEFAULT_PACKETS, corrupt_every = 0, rounds = DEFAULT_ROUNDS;
+	int c, i, j, rc = 0;
+
+	while( (c = getopt( argc, argv, "n:e:r:h" )) != -1 )
+	{
+		switch( c )
+		{
+		case 'n': packets = atoi( optarg ); break;
+		case 'e': corrupt_every = atoi( optarg ); break;
+		case 'r': rounds = atoi( optarg ); break;
+		default:  usage();
+		}
+	}
+
+	if( packets <= 0 || rounds <= 0 || corrupt_every < 0 )
+		usage();
+
+	if( optind < argc )
+		buf = load( argv[optind], &len );
+	else
+		buf = generate( packets, corrupt_every, &len );
+
+	if( buf == NULL )
+		return -1;
+
+	ts_classify_set_impl( TS_IMPL_AUTO );
+	printf( "%zu bytes, dispatch picks %s\n", len, ts_classify_impl_name() );
+
+	for( i = 0; i < sizeof(impls) / sizeof(impls[0]); i++ )
+	{
+		if( ts_classify_set_impl( impls[i].impl ) < 0 )
+		{
+			printf( "%-8s not supported by this CPU\n", impls[i].name );
+			continue;
+		}
+
+		best = ~0ULL;
+		for( j = 0; j < rounds; j++ )
+		{
+			t = now_us( );
+			run( buf, len, &blk, &r );
+			t = now_us( ) - t;
+			if( t < best )
+				best = t;
+		}
+
+		if( best == 0 )
+			best = 1;
+
+		pps = r.packets * 1e6 / best;
+		if( impls[i].impl == TS_IMPL_SCALAR )
+		{
+			scalar_pps = pps;
+			ref = r;
+		}
+
+		printf( "%-8s %10llu packets %8llu resync bytes %7llu PCRs  %8.2f Mpkt/s %8.1f MB/s  x%.2f%s\n",
+			impls[i].name, (unsigned long long) r.packets, (unsigned long long) r.resync_bytes,
+			(unsigned long long) r.pcrs, pps / 1e6, pps * TS_PACKET_SIZE / 1e6, pps / scalar_pps,
+			(r.sum == ref.sum && r.packets == ref.packets) ? "" : "  MISMATCH" );
+
+		if( r.sum != ref.sum || r.packets != ref.packets )
+			rc = 1;
+	}
+
+	free( buf );
+	return rc;
+}
@@ -0,0 +1,362 @@
+/* ts_classify.c -- bulk transport packet header decoding
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Each kernel classifies the leading run of in-sync packets it is given
+ * and returns how many that was; ts_classify() resyncs past whatever
+ * stopped it and calls it again. The vector kernels hand their tail and
+ * any group with a bad sync byte to the scalar one, so resync logic and
+ * the odd cases only live in one place.
+ */
+
+#include <string.h>
+
+#include "ts_classify.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define HAVE_X86 1
+#include <immintrin.h>
+#endif
+
+typedef int (*classify_fn)( const uint8_t *p, int npk, struct ts_block *blk, int n, uint32_t base );
+
+static classify_fn kernel = NULL;
+static const char *kernel_name = "none";
+
+
+/*
+  ###############################################################
+  #    Scalar                                                   #
+  ###############################################################
+*/
+static int run_scalar( const uint8_t *p, int npk, struct ts_block *blk, int n, uint32_t base )
+{
+	unsigned b1, b3, aflen, flags, payload;
+	int k;
+
+	for( k = 0; k < npk; k++, p += TS_PACKET_SIZE )
+	{
+		if( p[0] != TS_SYNC_BYTE )
+			break;
+
+		b1 = p[1];
+		b3 = p[3];
+		flags = 0;
+		payload = 4;
+
+		if( b1 & 0x40 ) flags |= TS_F_PUSI;
+		if( b1 & 0x80 ) flags |= TS_F_TEI;
+		if( b3 & 0xC0 ) flags |= TS_F_SCRAMBLED;
+
+		if( b3 & 0x20 )
+		{
+			aflen = p[4];
+			flags |= TS_F_AF;
+			payload = 5 + aflen;
+
+			if( aflen > TS_PACKET_SIZE - 5 )
+				flags |= TS_F_BAD_AF;
+			else if( aflen > 0 )
+			{
+				if( p[5] & 0x80 ) flags |= TS_F_DISC;
+				if( p[5] & 0x40 ) flags |= TS_F_RAI;
+				if( p[5] & 0x10 ) flags |= TS_F_PCR;
+			}
+		}
+
+		if( b3 & 0x10 )
+			flags |= TS_F_PAYLOAD;
+
+		if( !(b3 & 0x10) || payload > TS_NO_PAYLOAD )
+			payload = TS_NO_PAYLOAD;
+
+		blk->pid[n + k]     = ((b1 & 0x1F) << 8) | p[2];
+		blk->flags[n + k]   = flags;
+		blk->cc[n + k]      = b3 & 0x0F;
+		blk->payload[n + k] = payload;
+		blk->offset[n + k]  = base + k * TS_PACKET_SIZE;
+	}
+
+	return k;
+}
+
+#ifdef HAVE_X86
+/*
+  ###############################################################
+  #    SSE2: 4 packets per step, headers loaded one by one      #
+  ###############################################################
+*/
+static inline uint32_t load32( const uint8_t *p )
+{
+	uint32_t v;
+
+	memcpy( &v, p, sizeof(v) );
+	return v;
+}
+
+__attribute__((target("sse2")))
+static int run_sse2( const uint8_t *p, int npk, struct ts_block *blk, int n, uint32_t base )
+{
+	const __m128i stride = _mm_setr_epi32( 0, 188, 376, 564 );
+	const __m128i c_ff   = _mm_set1_epi32( 0xFF );
+	const __m128i c_47   = _mm_set1_epi32( TS_SYNC_BYTE );
+	const __m128i c_188  = _mm_set1_epi32( TS_NO_PAYLOAD );
+	const __m128i c_183  = _mm_set1_epi32( TS_PACKET_SIZE - 5 );
+	const __m128i zero   = _mm_setzero_si128();
+	__m128i h, a, t, af, pl, aflen, bad, good, flags, pid, cc, pay;
+	const uint8_t *q;
+	uint32_t v;
+	int k = 0;
+
+	while( k + 4 <= npk )
+	{
+		q = p + k * TS_PACKET_SIZE;
+		h = _mm_setr_epi32( load32( q ), load32( q + 188 ), load32( q + 376 ), load32( q + 564 ) );
+
+		t = _mm_cmpeq_epi32( _mm_and_si128( h, c_ff ), c_47 );
+		if( _mm_movemask_ps( _mm_castsi128_ps( t ) ) != 0xF )
+			break;
+
+		a = _mm_setr_epi32( load32( q + 4 ), load32( q + 192 ), load32( q + 380 ), load32( q + 568 ) );
+
+		pid   = _mm_or_si128( _mm_and_si128( h, _mm_set1_epi32( 0x1F00 ) ),
+				      _mm_and_si128( _mm_srli_epi32( h, 16 ), c_ff ) );
+		cc    = _mm_and_si128( _mm_srli_epi32( h, 24 ), _mm_set1_epi32( 0x0F ) );
+		af    = _mm_cmpeq_epi32( _mm_and_si128( h, _mm_set1_epi32( 0x20000000 ) ),
+					 _mm_set1_epi32( 0x20000000 ) );
+		pl    = _mm_cmpeq_epi32( _mm_and_si128( h, _mm_set1_epi32( 0x10000000 ) ), zero );
+		aflen = _mm_and_si128( a, c_ff );
+
+		// -- PUSI/TEI, AF, payload and scrambling sit at fixed bit positions
+		flags = _mm_and_si128( _mm_srli_epi32( h, 14 ), _mm_set1_epi32( TS_F_PUSI | TS_F_TEI ) );
+		flags = _mm_or_si128( flags, _mm_and_si128( _mm_srli_epi32( h, 26 ), _mm_set1_epi32( TS_F_AF ) ) );
+		flags = _mm_or_si128( flags, _mm_and_si128( _mm_srli_epi32( h, 24 ), _mm_set1_epi32( TS_F_PAYLOAD ) ) );
+		t     = _mm_cmpeq_epi32( _mm_srli_epi32( h, 30 ), zero );
+		flags = _mm_or_si128( flags, _mm_andnot_si128( t, _mm_set1_epi32( TS_F_SCRAMBLED ) ) );
+
+		bad   = _mm_and_si128( af, _mm_cmpgt_epi32( aflen, c_183 ) );
+		good  = _mm_andnot_si128( _mm_or_si128( bad, _mm_cmpeq_epi32( aflen, zero ) ), af );
+		t     = _mm_or_si128( _mm_and_si128( _mm_srli_epi32( a, 8 ), _mm_set1_epi32( 0xC0 ) ),
+				      _mm_and_si128( _mm_srli_epi32( a, 7 ), _mm_set1_epi32( TS_F_PCR ) ) );
+		flags = _mm_or_si128( flags, _mm_and_si128( good, t ) );
+		flags = _mm_or_si128( flags, _mm_and_si128( bad, _mm_set1_epi32( TS_F_BAD_AF ) ) );
+
+		// -- payload = 4, or 5 + aflen; TS_NO_PAYLOAD if absent or past the end
+		pay   = _mm_add_epi32( _mm_set1_epi32( 4 ), _mm_and_si128( af, _mm_add_epi32( aflen, _mm_set1_epi32( 1 ) ) ) );
+		t     = _mm_or_si128( pl, _mm_cmpgt_epi32( pay, c_188 ) );
+		pay   = _mm_or_si128( _mm_andnot_si128( t, pay ), _mm_and_si128( t, c_188 ) );
+
+		t = _mm_packs_epi32( pid, flags );
+		_mm_storel_epi64( (__m128i *) &blk->pid[n + k], t );
+		_mm_storel_epi64( (__m128i *) &blk->flags[n + k], _mm_srli_si128( t, 8 ) );
+
+		t = _mm_packus_epi16( _mm_packs_epi32( cc, pay ), zero );
+		v = _mm_cvtsi128_si32( t );
+		memcpy( &blk->cc[n + k], &v, 4 );
+		v = _mm_cvtsi128_si32( _mm_srli_si128( t, 4 ) );
+		memcpy( &blk->payload[n + k], &v, 4 );
+
+		_mm_storeu_si128( (__m128i *) &blk->offset[n + k],
+				  _mm_add_epi32( _mm_set1_epi32( base + k * TS_PACKET_SIZE ), stride ) );
+		k += 4;
+	}
+
+	return k + run_scalar( p + k * TS_PACKET_SIZE, npk - k, blk, n + k, base + k * TS_PACKET_SIZE );
+}
+
+/*
+  ###############################################################
+  #    AVX2: 8 packets per step, headers gathered at stride 188 #
+  ###############################################################
+*/
+__attribute__((target("avx2")))
+static int run_avx2( const uint8_t *p, int npk, struct ts_block *blk, int n, uint32_t base )
+{
+	const __m256i stride = _mm256_setr_epi32( 0, 188, 376, 564, 752, 940, 1128, 1316 );
+	const __m256i c_ff   = _mm256_set1_epi32( 0xFF );
+	const __m256i c_47   = _mm256_set1_epi32( TS_SYNC_BYTE );
+	const __m256i c_188  = _mm256_set1_epi32( TS_NO_PAYLOAD );
+	const __m256i c_183  = _mm256_set1_epi32( TS_PACKET_SIZE - 5 );
+	const __m256i zero   = _mm256_setzero_si256();
+	__m256i h, a, t, af, pl, aflen, bad, good, flags, pid, cc, pay;
+	__m128i b;
+	const uint8_t *q;
+	int k = 0;
+
+	while( k + 8 <= npk )
+	{
+		q = p + k * TS_PACKET_SIZE;
+		h = _mm256_i32gather_epi32( (const int *) q, stride, 1 );
+
+		t = _mm256_cmpeq_epi32( _mm256_and_si256( h, c_ff ), c_47 );
+		if( _mm256_movemask_ps( _mm256_castsi256_ps( t ) ) != 0xFF )
+			break;
+
+		a = _mm256_i32gather_epi32( (const int *) (q + 4), stride, 1 );
+
+		pid   = _mm256_or_si256( _mm256_and_si256( h, _mm256_set1_epi32( 0x1F00 ) ),
+					 _mm256_and_si256( _mm256_srli_epi32( h, 16 ), c_ff ) );
+		cc    = _mm256_and_si256( _mm256_srli_epi32( h, 24 ), _mm256_set1_epi32( 0x0F ) );
+		af    = _mm256_cmpeq_epi32( _mm256_and_si256( h, _mm256_set1_epi32( 0x20000000 ) ),
+					    _mm256_set1_epi32( 0x20000000 ) );
+		pl    = _mm256_cmpeq_epi32( _mm256_and_si256( h, _mm256_set1_epi32( 0x10000000 ) ), zero );
+		aflen = _mm256_and_si256( a, c_ff );
+
+		flags = _mm256_and_si256( _mm256_srli_epi32( h, 14 ), _mm256_set1_epi32( TS_F_PUSI | TS_F_TEI ) );
+		flags = _mm256_or_si256( flags, _mm256_and_si256( _mm256_srli_epi32( h, 26 ), _mm256_set1_epi32( TS_F_AF ) ) );
+		flags = _mm256_or_si256( flags, _mm256_and_si256( _mm256_srli_epi32( h, 24 ), _mm256_set1_epi32( TS_F_PAYLOAD ) ) );
+		t     = _mm256_cmpeq_epi32( _mm256_srli_epi32( h, 30 ), zero );
+		flags = _mm256_or_si256( flags, _mm256_andnot_si256( t, _mm256_set1_epi32( TS_F_SCRAMBLED ) ) );
+
+		bad   = _mm256_and_si256( af, _mm256_cmpgt_epi32( aflen, c_183 ) );
+		good  = _mm256_andnot_si256( _mm256_or_si256( bad, _mm256_cmpeq_epi32( aflen, zero ) ), af );
+		t     = _mm256_or_si256( _mm256_and_si256( _mm256_srli_epi32( a, 8 ), _mm256_set1_epi32( 0xC0 ) ),
+					 _mm256_and_si256( _mm256_srli_epi32( a, 7 ), _mm256_set1_epi32( TS_F_PCR ) ) );
+		flags = _mm256_or_si256( flags, _mm256_and_si256( good, t ) );
+		flags = _mm256_or_si256( flags, _mm256_and_si256( bad, _mm256_set1_epi32( TS_F_BAD_AF ) ) );
+
+		pay   = _mm256_add_epi32( _mm256_set1_epi32( 4 ), _mm256_and_si256( af, _mm256_add_epi32( aflen, _mm256_set1_epi32( 1 ) ) ) );
+		pay   = _mm256_min_epi32( pay, c_188 );
+		pay   = _mm256_blendv_epi8( pay, c_188, pl );
+
+		// -- packus works per 128 bit lane; the permute puts the quads back in order
+		t = _mm256_permute4x64_epi64( _mm256_packus_epi32( pid, flags ), 0xD8 );
+		_mm_storeu_si128( (__m128i *) &blk->pid[n + k], _mm256_castsi256_si128( t ) );
+		_mm_storeu_si128( (__m128i *) &blk->flags[n + k], _mm256_extracti128_si256( t, 1 ) );
+
+		t = _mm256_permute4x64_epi64( _mm256_packus_epi32( cc, pay ), 0xD8 );
+		b = _mm_packus_epi16( _mm256_castsi256_si128( t ), _mm256_extracti128_si256( t, 1 ) );
+		_mm_storel_epi64( (__m128i *) &blk->cc[n + k], b );
+		_mm_storel_epi64( (__m128i *) &blk->payload[n + k], _mm_srli_si128( b, 8 ) );
+
+		_mm256_storeu_si256( (__m256i *) &blk->offset[n + k],
+				     _mm256_add_epi32( _mm256_set1_epi32( base + k * TS_PACKET_SIZE ), stride ) );
+		k += 8;
+	}
+
+	return k + run_scalar( p + k * TS_PACKET_SIZE, npk - k, blk, n + k, base + k * TS_PACKET_SIZE );
+}
+#endif /* HAVE_X86 */
+
+/*
+  ###############################################################
+  #    Dispatch                                                 #
+  ###############################################################
+*/
+int ts_classify_set_impl( enum ts_classify_impl impl )
+{
+#ifdef HAVE_X86
+	__builtin_cpu_init( );
+
+	if( impl == TS_IMPL_AUTO )
+	{
+		if( __builtin_cpu_supports( "avx2" ) )
+			impl = TS_IMPL_AVX2;
+		else if( __builtin_cpu_supports( "sse2" ) )
+			impl = TS_IMPL_SSE2;
+		else
+			impl = TS_IMPL_SCALAR;
+	}
+
+	if( impl == TS_IMPL_AVX2 )
+	{
+		if( !__builtin_cpu_supports( "avx2" ) )
+			return -1;
+		kernel = run_avx2;
+		kernel_name = "avx2";
+		return 0;
+	}
+
+	if( impl == TS_IMPL_SSE2 )
+	{
+		if( !__builtin_cpu_supports( "sse2" ) )
+			return -1;
+		kernel = run_sse2;
+		kernel_name = "sse2";
+		return 0;
+	}
+#else
+	if( impl != TS_IMPL_AUTO && impl != TS_IMPL_SCALAR )
+		return -1;
+#endif
+
+	kernel = run_scalar;
+	kernel_name = "scalar";
+	return 0;
+}
+
+const char *ts_classify_impl_name( void )
+{
+	if( kernel == NULL )
+		ts_classify_set_impl( TS_IMPL_AUTO );
+
+	return kernel_name;
+}
+
+/*
+  ###############################################################
+  #    Next offset with three sync bytes one packet apart       #
+  ###############################################################
+*/
+static size_t resync( const uint8_t *buf, size_t len )
+{
+	const uint8_t *p = buf + 1, *end = buf + len;
+	size_t i;
+
+	while( p < end && (p = memchr( p, TS_SYNC_BYTE, end - p )) != NULL )
+	{
+		i = p - buf;
+
+		// -- Whatever lies past the end of the buffer gets the benefit of the doubt
+		if( (i + TS_PACKET_SIZE >= len || buf[i + TS_PACKET_SIZE] == TS_SYNC_BYTE) &&
+		    (i + 2 * TS_PACKET_SIZE >= len || buf[i + 2 * TS_PACKET_SIZE] == TS_SYNC_BYTE) )
+			return i;
+
+		p++;
+	}
+
+	return len;
+}
+
+int ts_classify( const uint8_t *buf, size_t len, struct ts_block *blk )
+{
+	size_t pos = 0, skip;
+	int n = 0, got, avail;
+
+	if( kernel == NULL )
+		ts_classify_set_impl( TS_IMPL_AUTO );
+
+	blk->resync_bytes = 0;
+
+	while( n < TS_BLOCK_MAX && len - pos >= TS_PACKET_SIZE )
+	{
+		avail = (len - pos) / TS_PACKET_SIZE;
+		if( avail > TS_BLOCK_MAX - n )
+			avail = TS_BLOCK_MAX - n;
+
+		got = kernel( buf + pos, avail, blk, n, (uint32_t) pos );
+		n   += got;
+		pos += (size_t) got * TS_PACKET_SIZE;
+
+		if( got < avail )
+		{
+			skip = resync( buf + pos, len - pos );
+			blk->resync_bytes += skip;
+			pos += skip;
+		}
+	}
+
+	blk->count = n;
+	blk->consumed = pos;
+
+	return n;
+}
+
+uint64_t ts_pcr( const uint8_t *pkt )
+{
+	uint64_t base;
+
+	base = ((uint64_t) pkt[6] << 25) | (pkt[7] << 17) | (pkt[8] << 9) | (pkt[9] << 1) | (pkt[10] >> 7);
+
+	return base * 300 + (((pkt[10] & 0x01) << 8) | pkt[11]);
+}
@@ -0,0 +1,69 @@
+#ifndef _TS_CLASSIFY_H_
+#define _TS_CLASSIFY_H_
+/* ts_classify.h -- bulk transport packet header decoding
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Splits a buffer of 188 byte packets into compact per-block arrays
+ * (PID, flags, continuity counter, payload offset, packet offset) for
+ * the stages that work on whole captures: indexing, extraction, stats.
+ * The header decode runs 8 packets at a time with AVX2 gathers, 4 at a
+ * time with SSE2, or one by one; the widest the CPU has is picked on
+ * first use. All three produce identical output.
+ *
+ * Packets are expected back to back. When a sync byte is missing the
+ * classifier skips to the next offset that has a 0x47 followed by two
+ * more one packet apart, counts the bytes it dropped and carries on.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define TS_PACKET_SIZE                       188
+#define TS_SYNC_BYTE                        0x47
+#define TS_BLOCK_MAX                         512  /* packets per ts_block */
+#define TS_NO_PAYLOAD             TS_PACKET_SIZE
+
+/* ts_block.flags */
+#define TS_F_PUSI                         0x0001  /* payload_unit_start_indicator */
+#define TS_F_TEI                          0x0002  /* transport_error_indicator */
+#define TS_F_SCRAMBLED                    0x0004
+#define TS_F_AF                           0x0008  /* adaptation field present */
+#define TS_F_PAYLOAD                      0x0010
+#define TS_F_PCR                          0x0020  /* adaptation field carries a PCR */
+#define TS_F_RAI                          0x0040  /* random_access_indicator */
+#define TS_F_DISC                         0x0080  /* discontinuity_indicator */
+#define TS_F_BAD_AF                       0x0100  /* adaptation_field_length runs past the packet */
+
+struct ts_block {
+	int      count;
+	size_t   consumed;                /* bytes of the input this block covers */
+	size_t   resync_bytes;            /* bytes skipped to regain sync */
+
+	uint16_t pid [TS_BLOCK_MAX];
+	uint16_t flags [TS_BLOCK_MAX];
+	uint8_t  cc [TS_BLOCK_MAX];
+	uint8_t  payload [TS_BLOCK_MAX];  /* offset into the packet, TS_NO_PAYLOAD if none */
+	uint32_t offset [TS_BLOCK_MAX];   /* of the packet in the input */
+};
+
+enum ts_classify_impl {
+	TS_IMPL_AUTO,
+	TS_IMPL_SCALAR,
+	TS_IMPL_SSE2,
+	TS_IMPL_AVX2,
+};
+
+/* Classify up to TS_BLOCK_MAX packets from buf. Stops early at a
+ * trailing partial packet; blk->consumed says where to continue. */
+extern int         ts_classify( const uint8_t *buf, size_t len, struct ts_block *blk );
+
+/* Force an implementation (benchmarks, tests); -1 if the CPU lacks it */
+extern int         ts_classify_set_impl( enum ts_classify_impl impl );
+extern const char *ts_classify_impl_name( void );
+
+/* 27 MHz PCR of a packet flagged TS_F_PCR */
+extern uint64_t    ts_pcr( const uint8_t *pkt );
+
+
+#endif /* _TS_CLASSIFY_H_ */
@@ -0,0 +1,782 @@
+/* ts_extract.c -- pull one program or time range out of an indexed recording
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Goes by the sidecar index hdtvrecorder writes (ts_index.h): the start
+ * and end times are looked up in the PCRs of the program, the start is
+ * moved back to the random access point before it, and then only the
+ * blocks of the file that hold one of the program's PIDs are read, with
+ * pread() or out of a mapping (-m). Blocks the index does not cover yet
+ * (a recording still going) are read in full.
+ *
+ * A recording hdtvrecorder cut into segments (mux.0000.ts, mux.0001.ts,
+ * ... see ts_store.h) is given by the name it was recorded under,
+ * mux.ts. Each segment has an index of its own; their PCRs are put on
+ * one timeline, the start and end are looked up on it and the segments
+ * in between are read in turn.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <dirent.h>
+#include <time.h>
+
+#include "common.h"
+#include "channels.h"
+#include "ts_classify.h"
+#include "ts_index.h"
+#include "ts_store.h"
+
+#define CHANNEL_FILE "channels.cache"
+#define PAT_PID                             0x0000
+#define CHUNK_SIZE                 (4 * 1024 * 1024)
+#define OUT_SIZE                   (TS_PACKET_SIZE * 4096)
+
+/* One file of the recording and its index */
+struct segment {
+	char    *path;
+	struct ts_index *idx;
+	uint64_t pcr_first;               /* of the clock PID, on the timeline of the whole series */
+	uint64_t pcr_last;
+	int      has_pcr;
+};
+
+struct extract {
+	struct segment *segs;
+	int      num_segs;
+	int      use_mmap;
+
+	int      fd;                      /* segment being read */
+	int      out;
+	const uint8_t *map;               /* whole segment with -m, else NULL */
+	uint8_t *buf;
+	uint64_t file_size;
+	uint64_t total_size;              /* of every segment */
+
+	uint8_t  pids [TS_INDEX_NUM_PIDS];
+	uint64_t first_packet;
+	uint64_t last_packet;
+
+	uint8_t  obuf [OUT_SIZE];
+	size_t   olen;
+
+	uint64_t bytes_read;
+	uint64_t packets_out;
+	uint64_t runs;
+	struct ts_block blk;
+};
+
+static uint64_t now_us( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int flush_out( struct extract *x )
+{
+	ssize_t n;
+	size_t done;
+
+	for( done = 0; done < x->olen; done += n )
+	{
+		if( (n = write( x->out, x->obuf + done, x->olen - done )) < 0 )
+		{
+			if( errno == EINTR )
+			{
+				n = 0;
+				continue;
+			}
+			PERROR( "write of extract failed" );
+			return -1;
+		}
+	}
+
+	x->olen = 0;
+	return 0;
+}
+
+/* len bytes of the recording at off, NULL on a read error */
+static const uint8_t *fetch( struct extract *x, uint64_t off, size_t len )
+{
+	ssize_t n;
+	size_t got;
+
+	x->bytes_read += len;
+
+	if( x->map != NULL )
+		return x->map + off;
+
+	for( got = 0; got < len; got += n )
+	{
+		if( (n = pread( x->fd, x->buf + got, len - got, off + got )) <= 0 )
+		{
+			if( n < 0 && errno == EINTR )
+			{
+				n = 0;
+				continue;
+			}
+			PERROR( "read of recording failed" );
+			return NULL;
+		}
+	}
+
+	return x->buf;
+}
+
+/*
+  ###############################################################
+  #    Segments: which files make up the recording              #
+  ###############################################################
+*/
+static int add_segment( struct extract *x, const char *path, const char *index_path )
+{
+	struct segment *s;
+	struct stat st;
+	char *idx_path;
+
+	if( (x->num_segs & 15) == 0 )
+	{
+		if( (s = realloc( x->segs, (x->num_segs + 16) * sizeof(struct segment) )) == NULL )
+			return -1;
+		x->segs = s;
+	}
+
+	s = &x->segs[x->num_segs];
+	memset( s, 0, sizeof(*s) );
+
+	if( (s->path = strdup( path )) == NULL )
+		return -1;
+
+	if( index_path == NULL )
+	{
+		if( (idx_path = malloc( strlen( path ) + sizeof(TS_INDEX_SUFFIX) )) == NULL )
+			return -1;
+		sprintf( idx_path, "%s%s", path, TS_INDEX_SUFFIX );
+		s->idx = ts_index_open( idx_path );
+		free( idx_path );
+	}
+	else
+		s->idx = ts_index_open( index_path );
+
+	if( s->idx == NULL )
+	{
+		free( s->path );
+		return -1;
+	}
+
+	if( stat( path, &st ) == 0 )
+		x->total_size += st.st_size - st.st_size % TS_PACKET_SIZE;
+
+	x->num_segs++;
+	return 0;
+}
+
+/* A file of that name is a recording (or one segment) on its own,
+ * otherwise it names a series: every segment from the oldest still
+ * there (hdtvrecorder -R deletes from the front) up to the first gap */
+static int load_recording( struct extract *x, const char *path, const char *index_path )
+{
+	char dir[PATH_MAX], name[PATH_MAX];
+	const char *slash = strrchr( path, '/' );
+	struct dirent *de;
+	struct stat st;
+	DIR *d;
+	int seg, first = -1;
+
+	if( stat( path, &st ) == 0 )
+		return add_segment( x, path, index_path );
+
+	if( index_path != NULL )
+	{
+		ERROR( "no '%s', and -x only goes with a single file", path );
+		return -1;
+	}
+
+	if( slash == NULL )
+		strcpy( dir, "." );
+	else if( slash == path )
+		strcpy( dir, "/" );
+	else
+		snprintf( dir, sizeof(dir), "%.*s", (int) (slash - path), path );
+
+	if( (d = opendir( dir )) == NULL )
+	{
+		PERROR( "failed opening '%s'", dir );
+		return -1;
+	}
+
+	while( (de = readdir( d )) != NULL )
+	{
+		snprintf( name, sizeof(name), "%.*s%s", slash == NULL ? 0 : (int) (slash - path + 1), path, de->d_name );
+		seg = ts_store_segment_number( path, name );
+		if( seg >= 0 && (first < 0 || seg < first) )
+			first = seg;
+	}
+
+	closedir( d );
+
+	if( first < 0 )
+	{
+		ERROR( "no '%s' and no segments of it", path );
+		return -1;
+	}
+
+	for( seg = first; ts_store_segment_name( path, seg, name, sizeof(name) ) == 0 && stat( name, &st ) == 0; seg++ )
+	{
+		if( add_segment( x, name, NULL ) < 0 )
+			return -1;
+	}
+
+	return 0;
+}
+
+static int open_segment( struct extract *x, const struct segment *s )
+{
+	struct stat st;
+
+	if( (x->fd = open( s->path, O_RDONLY )) < 0 || fstat( x->fd, &st ) < 0 )
+	{
+		PERROR( "failed opening '%s'", s->path );
+		return -1;
+	}
+
+	x->file_size = st.st_size - st.st_size % TS_PACKET_SIZE;
+	x->map = NULL;
+
+	if( x->use_mmap && x->file_size > 0 )
+	{
+		x->map = mmap( NULL, x->file_size, PROT_READ, MAP_SHARED, x->fd, 0 );
+		if( x->map == MAP_FAILED )
+		{
+			PERROR( "mmap of '%s' failed", s->path );
+			close( x->fd );
+			return -1;
+		}
+		madvise( (void *) x->map, x->file_size, MADV_RANDOM );
+	}
+
+	return 0;
+}
+
+static void close_segment( struct extract *x )
+{
+	if( x->map != NULL )
+		munmap( (void *) x->map, x->file_size );
+
+	close( x->fd );
+}
+
+/*
+  ###############################################################
+  #    One clock across the segments                            #
+  ###############################################################
+*/
+static void series_timeline( struct extract *x, uint16_t pcr_pid )
+{
+	const struct ts_index_entry *e;
+	struct segment *s;
+	uint64_t offset = 0, prev = 0;
+	size_t i;
+	int n, have_prev = 0;
+
+	for( n = 0; n < x->num_segs; n++ )
+	{
+		s = &x->segs[n];
+		s->has_pcr = 0;
+
+		for( i = 0; i < s->idx->num_entries; i++ )
+		{
+			e = &s->idx->entries[i];
+			if( e->type != TS_INDEX_PCR || e->pid != pcr_pid )
+				continue;
+
+			if( !s->has_pcr )
+				s->pcr_first = e->pcr;
+			s->pcr_last = e->pcr;
+			s->has_pcr  = 1;
+		}
+
+		if( !s->has_pcr )
+			continue;
+
+		// -- Every index unwraps from its own first PCR, so the series has to carry the wraps over
+		if( have_prev && s->pcr_first + offset + TS_INDEX_PCR_WRAP / 2 < prev )
+			offset += TS_INDEX_PCR_WRAP;
+
+		s->pcr_first += offset;
+		s->pcr_last  += offset;
+		prev      = s->pcr_last;
+		have_prev = 1;
+	}
+}
+
+/* Last random access point of pid at or before packet, -1 for none */
+static int64_t last_rap( const struct ts_index *idx, uint16_t pid, uint64_t packet )
+{
+	const struct ts_index_entry *e;
+	size_t i;
+
+	for( i = idx->num_entries; i-- > 0; )
+	{
+		e = &idx->entries[i];
+		if( e->type == TS_INDEX_RAP && e->pid == pid && e->packet <= packet )
+			return e->packet;
+	}
+
+	return -1;
+}
+
+/* Segment and packet in it at seconds along the series' clock, moved back
+ * to the random access point of rap_pid before it, which can be in the
+ * segment before. -1 if pcr_pid has no PCRs. */
+static int series_seek( struct extract *x, uint16_t pcr_pid, uint16_t rap_pid, double seconds, int *seg, int64_t *packet )
+{
+	const struct segment *s = NULL;
+	uint64_t target = 0;
+	int64_t rap;
+	int n, found = 0;
+
+	for( n = 0; n < x->num_segs; n++ )
+	{
+		s = &x->segs[n];
+		if( !s->has_pcr )
+			continue;
+
+		if( !found )
+		{
+			target = s->pcr_first + (uint64_t) (seconds * 27000000.0);
+			found = 1;
+		}
+
+		// -- Between two segments' PCRs: the later one from its start
+		if( target < s->pcr_first )
+		{
+			*packet = 0;
+			break;
+		}
+
+		if( target <= s->pcr_last || n == x->num_segs - 1 )
+		{
+			*packet = ts_index_seek( s->idx, pcr_pid, TS_INDEX_NO_PID, (target - s->pcr_first) / 27000000.0 );
+			break;
+		}
+	}
+
+	if( !found )
+		return -1;
+
+	// -- Past the last PCR of a series whose last segment has none
+	if( n == x->num_segs )
+	{
+		*seg    = x->num_segs - 1;
+		*packet = INT64_MAX;
+		return 0;
+	}
+
+	*seg = n;
+
+	if( rap_pid == TS_INDEX_NO_PID )
+		return 0;
+
+	if( (rap = last_rap( s->idx, rap_pid, *packet )) >= 0 )
+		*packet = rap;
+	else if( n > 0 && (rap = last_rap( x->segs[n - 1].idx, rap_pid, UINT64_MAX )) >= 0 )
+	{
+		*seg    = n - 1;
+		*packet = rap;
+	}
+
+	return 0;
+}
+
+/*
+  ###############################################################
+  #    PMT PID of a program, from the first PAT in the file     #
+  ###############################################################
+*/
+static int find_pmt( struct extract *x, const struct ts_index *idx, uint16_t program )
+{
+	const struct ts_index_entry *e;
+	const uint8_t *p, *pkt, *sec;
+	uint64_t block = ~0ULL, off;
+	size_t len, i;
+	int n, j, section_length;
+
+	for( i = 0; i < idx->num_entries; i++ )
+	{
+		e = &idx->entries[i];
+		if( e->type == TS_INDEX_RANGE && e->pid == PAT_PID && e->packet < block )
+			block = e->packet;
+	}
+
+	if( block == ~0ULL )
+		return -1;
+
+	off = block * idx->hdr.block_packets * TS_PACKET_SIZE;
+	len = (size_t) idx->hdr.block_packets * TS_PACKET_SIZE;
+	if( off + len > x->file_size )
+		len = x->file_size - off;
+
+	if( (p = fetch( x, off, len )) == NULL )
+		return -1;
+
+	ts_classify( p, len, &x->blk );
+
+	for( n = 0; n < x->blk.count; n++ )
+	{
+		if( x->blk.pid[n] != PAT_PID || !(x->blk.flags[n] & TS_F_PUSI) || x->blk.payload[n] == TS_NO_PAYLOAD )
+			continue;
+
+		pkt = p + x->blk.offset[n];
+		sec = pkt + x->blk.payload[n] + 1 + pkt[x->blk.payload[n]];
+		if( sec + 8 > pkt + TS_PACKET_SIZE || sec[0] != 0x00 )
+			continue;
+
+		section_length = ((sec[1] & 0x0F) << 8) | sec[2];
+		if( sec + 3 + section_length > pkt + TS_PACKET_SIZE )
+			continue;
+
+		for( j = 8; j + 4 <= 3 + section_length - 4; j += 4 )
+		{
+			if( ((sec[j] << 8) | sec[j+1]) == program )
+				return ((sec[j+2] & 0x1F) << 8) | sec[j+3];
+		}
+	}
+
+	return -1;
+}
+
+/*
+  ###############################################################
+  #    Copy the wanted packets of blocks [first, last)          #
+  ###############################################################
+*/
+static int extract_run( struct extract *x, const struct ts_index *idx, uint64_t first, uint64_t last )
+{
+	struct ts_block *blk = &x->blk;
+	size_t block_size = (size_t) idx->hdr.block_packets * TS_PACKET_SIZE;
+	uint64_t off, end, packet;
+	const uint8_t *p;
+	size_t len, pos;
+	int i;
+
+	x->runs++;
+
+	end = last * block_size;
+	if( end > x->file_size )
+		end = x->file_size;
+
+	for( off = first * block_size; off < end; off += len )
+	{
+		len = CHUNK_SIZE - CHUNK_SIZE % block_size;
+		if( len == 0 )
+			len = block_size;
+		if( off + len > end )
+			len = end - off;
+
+		if( x->map == NULL && off + len < end )
+			posix_fadvise( x->fd, off + len, end - off - len < CHUNK_SIZE ? end - off - len : CHUNK_SIZE, POSIX_FADV_WILLNEED );
+
+		if( (p = fetch( x, off, len )) == NULL )
+			return -1;
+
+		for( pos = 0; len - pos >= TS_PACKET_SIZE; pos += blk->consumed )
+		{
+			ts_classify( p + pos, len - pos, blk );
+
+			for( i = 0; i < blk->count; i++ )
+			{
+				if( !x->pids[blk->pid[i]] )
+					continue;
+
+				packet = (off + pos + blk->offset[i]) / TS_PACKET_SIZE;
+				if( packet < x->first_packet || packet >= x->last_packet )
+					continue;
+
+				memcpy( x->obuf + x->olen, p + pos + blk->offset[i], TS_PACKET_SIZE );
+				x->olen += TS_PACKET_SIZE;
+				x->packets_out++;
+
+				if( x->olen == OUT_SIZE && flush_out( x ) < 0 )
+					return -1;
+			}
+
+			if( blk->consumed == 0 )
+				break;
+		}
+	}
+
+	return 0;
+}
+
+static int parse_pids( const char *list, uint8_t *pids )
+{
+	char *end;
+	unsigned long pid;
+
+	while( *list )
+	{
+		pid = strtoul( list, &end, 0 );
+		if( end == list || pid >= TS_INDEX_NUM_PIDS )
+			return -1;
+
+		pids[pid] = 1;
+		list = *end == ',' ? end + 1 : end;
+	}
+
+	return 0;
+}
+
+/*###############################################################
+  #   Display usage and exit                                    #
+  ###############################################################*/
+void usage()
+{
+     fprintf( stdout, "usage: ts_extract [options] recording.ts output.ts\n" );
+     fprintf( stdout, "       (recording.ts can also name a series recording.0000.ts, recording.0001.ts, ...)\n" );
+     fprintf( stdout, "  -c channel        major.minor or name from the scan cache: its PAT, PMT, PCR and ES PIDs\n" );
+     fprintf( stdout, "  -f file           scan cache [Default: %s]\n", CHANNEL_FILE );
+     fprintf( stdout, "  -p pid,pid,...    (also) these PIDs\n" );
+     fprintf( stdout, "  -s seconds        start this far in, along the program's PCR [Default: 0]\n" );
+     fprintf( stdout, "  -d seconds        this much of it [Default: to the end]\n" );
+     fprintf( stdout, "  -x index          single file only [Default: recording.ts%s]\n", TS_INDEX_SUFFIX );
+     fprintf( stdout, "  -m                mmap the recording instead of pread()\n" );
+     exit( 0 );
+}
+
+/*###############################################################
+  #  Main program Entry                                         #
+  ###############################################################*/
+int main( int argc, char *argv[] )
+{
+	static struct extract x;
+	struct ts_index *idx;
+	struct segment *s;
+	struct channel_list list;
+	struct channel_entry *channel = NULL;
+	char *file = CHANNEL_FILE, *key = NULL, *pid_list = NULL, *index_path = NULL;
+	double start = 0, duration = 0;
+	uint64_t blocks, first, last, b, e, t, files, out_before;
+	uint8_t *map = NULL;
+	size_t block_size, max_block = 0, i;
+	int64_t first_packet = 0, last_packet = INT64_MAX;
+	int first_seg = 0, last_seg, n;
+	int pcr_pid = -1, rap_pid = TS_INDEX_NO_PID, pmt = -1, c, rc = 0;
+
+	memset( &list, 0, sizeof(list) );
+
+	while( (c = getopt( argc, argv, "c:f:p:s:d:x:mh" )) != -1 )
+	{
+		switch( c )
+		{
+		case 'c': key = optarg; break;
+		case 'f': file = optarg; break;
+		case 'p': pid_list = optarg; break;
+		case 's': start = atof( optarg ); break;
+		case 'd': duration = atof( optarg ); break;
+		case 'x': index_path = optarg; break;
+		case 'm': x.use_mmap = 1; break;
+		default:  usage();
+		}
+	}
+
+	if( optind != argc - 2 || (key == NULL && pid_list == NULL) || start < 0 || duration < 0 )
+		usage();
+
+	if( pid_list != NULL && parse_pids( pid_list, x.pids ) < 0 )
+	{
+		ERROR( "bad PID list '%s'", pid_list );
+		return -1;
+	}
+
+	if( load_recording( &x, argv[optind], index_path ) < 0 )
+		return -1;
+
+	last_seg = x.num_segs - 1;
+
+	for( n = 0; n < x.num_segs; n++ )
+	{
+		block_size = (size_t) x.segs[n].idx->hdr.block_packets * TS_PACKET_SIZE;
+		if( block_size > max_block )
+			max_block = block_size;
+	}
+
+	if( !x.use_mmap && (x.buf = malloc( CHUNK_SIZE > max_block ? CHUNK_SIZE : max_block )) == NULL )
+		return -1;
+
+	if( key != NULL )
+	{
+		if( channels_load( file, &list ) < 0 )
+			return -1;
+
+		if( (channel = channels_find( &list, key )) == NULL )
+		{
+			ERROR( "channel '%s' not found in %s", key, file );
+			return -1;
+		}
+
+		x.pids[PAT_PID] = 1;
+		if( channel->pcr_pid != 0 )
+		{
+			x.pids[channel->pcr_pid] = 1;
+			pcr_pid = channel->pcr_pid;
+		}
+
+		for( i = 0; i < channel->num_pids; i++ )
+		{
+			x.pids[channel->pids[i]] = 1;
+			if( channel->types[i] == 0x02 && rap_pid == TS_INDEX_NO_PID )
+				rap_pid = channel->pids[i];
+		}
+
+		// -- Older caches have no PMT PID; then it comes from the recording's PAT
+		if( channel->pmt_pid != 0 )
+			pmt = channel->pmt_pid;
+
+		for( n = 0; n < x.num_segs && pmt < 0; n++ )
+		{
+			if( open_segment( &x, &x.segs[n] ) < 0 )
+				return -1;
+			if( x.file_size > 0 )
+				pmt = find_pmt( &x, x.segs[n].idx, channel->program );
+			close_segment( &x );
+		}
+
+		if( pmt >= 0 )
+			x.pids[pmt] = 1;
+		else
+			printf( "No PAT entry for program %u, extracting without its PMT\n", channel->program );
+
+		printf( "%u.%u %s: program %u, PMT 0x%x, PCR 0x%x\n", channel->major, channel->minor,
+			channel->name, channel->program, pmt >= 0 ? pmt : 0, channel->pcr_pid );
+	}
+
+	// -- Without a channel, the first requested PID that has PCRs is the clock
+	for( n = 0; pcr_pid < 0 && n < x.num_segs; n++ )
+	{
+		idx = x.segs[n].idx;
+		for( i = 0; pcr_pid < 0 && i < idx->num_entries; i++ )
+		{
+			if( idx->entries[i].type == TS_INDEX_PCR && x.pids[idx->entries[i].pid] )
+				pcr_pid = idx->entries[i].pid;
+		}
+	}
+
+	if( rap_pid == TS_INDEX_NO_PID && pcr_pid >= 0 )
+		rap_pid = pcr_pid;
+
+	if( start > 0 || duration > 0 )
+	{
+		if( pcr_pid >= 0 )
+			series_timeline( &x, pcr_pid );
+
+		if( pcr_pid < 0 || series_seek( &x, pcr_pid, rap_pid, start, &n, &first_packet ) < 0 )
+		{
+			ERROR( "no PCRs indexed for the PIDs asked for, cannot seek" );
+			return -1;
+		}
+
+		if( start > 0 )
+			first_seg = n;
+		else
+			first_packet = 0;
+
+		if( duration > 0 )
+			series_seek( &x, pcr_pid, TS_INDEX_NO_PID, start + duration, &last_seg, &last_packet );
+	}
+
+	if( (x.out = open( argv[optind + 1], O_WRONLY | O_CREAT | O_TRUNC, 0644 )) < 0 )
+	{
+		PERROR( "failed creating '%s'", argv[optind + 1] );
+		return -1;
+	}
+
+	t = now_us( );
+
+	for( n = first_seg; n <= last_seg && rc == 0; n++ )
+	{
+		s   = &x.segs[n];
+		idx = s->idx;
+
+		if( open_segment( &x, s ) < 0 )
+		{
+			rc = -1;
+			break;
+		}
+
+		files = x.file_size / TS_PACKET_SIZE;
+
+		x.first_packet = n == first_seg ? first_packet : 0;
+		x.last_packet  = n == last_seg && (uint64_t) last_packet < files ? (uint64_t) last_packet : files;
+
+		block_size = (size_t) idx->hdr.block_packets * TS_PACKET_SIZE;
+		blocks     = (x.file_size + block_size - 1) / block_size;
+
+		first = x.first_packet / idx->hdr.block_packets;
+		last  = (x.last_packet + idx->hdr.block_packets - 1) / idx->hdr.block_packets;
+		if( last > blocks )
+			last = blocks;
+
+		if( (map = realloc( map, last > first ? last - first : 1 )) == NULL )
+			return -1;
+
+		out_before = x.packets_out;
+		ts_index_blocks( idx, x.pids, first, last, map );
+
+		for( b = first; b < last; b = e )
+		{
+			if( !map[b - first] )
+			{
+				e = b + 1;
+				continue;
+			}
+
+			for( e = b + 1; e < last && map[e - first]; e++ )
+				;
+
+			if( extract_run( &x, idx, b, e ) < 0 )
+			{
+				rc = -1;
+				break;
+			}
+		}
+
+		printf( "%s: packets %llu..%llu, %llu packets out\n", s->path, (unsigned long long) x.first_packet,
+			(unsigned long long) x.last_packet, (unsigned long long) (x.packets_out - out_before) );
+
+		close_segment( &x );
+	}
+
+	if( rc == 0 && flush_out( &x ) < 0 )
+		rc = -1;
+
+	t = now_us( ) - t;
+
+	printf( "read %.1f of %.1f MB (%.1f%%) in %llu runs, %.3f s\n", x.bytes_read / 1e6, x.total_size / 1e6,
+		x.total_size ? 100.0 * x.bytes_read / x.total_size : 0, (unsigned long long) x.runs, t / 1e6 );
+
+	close( x.out );
+	free( map );
+	free( x.buf );
+
+	for( n = 0; n < x.num_segs; n++ )
+	{
+		free( x.segs[n].path );
+		ts_index_free( x.segs[n].idx );
+	}
+	free( x.segs );
+	channels_free( &list );
+
+	return rc;
+}
@@ -0,0 +1,433 @@
+/* ts_index.c -- sidecar packet index for transport stream recordings
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * The writer keeps one open run per PID. Seeing a PID again after a
+ * gap emits the run so far and starts a new one; every sync point
+ * emits all of them, so long runs (the video PID of a full mux is in
+ * every block) never sit in memory for more than TS_INDEX_SYNC_BLOCKS.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include "common.h"
+#include "ts_index.h"
+
+#define INDEX_BATCH                          256  /* entries per write() between syncs */
+
+struct index_pid {
+	uint64_t first;                   /* open run: first block */
+	uint64_t last;                    /* and the last block the pid was seen in */
+	uint64_t pcr;                     /* unwrapped, last seen */
+	uint64_t pcr_logged;
+	uint8_t  open;
+	uint8_t  has_pcr;
+};
+
+struct ts_index_writer {
+	int      fd;
+	int      failed;
+	uint32_t block_packets;
+	uint64_t packets;
+	uint64_t next_sync;               /* packet number of the next sync point */
+
+	struct index_pid pid [TS_INDEX_NUM_PIDS];
+	uint16_t open [TS_INDEX_NUM_PIDS];
+	int      num_open;
+
+	int      num_pending;
+	struct ts_index_entry pending [INDEX_BATCH];
+};
+
+
+/*
+  ###############################################################
+  #    Writer                                                   #
+  ###############################################################
+*/
+static int index_flush( struct ts_index_writer *w )
+{
+	const uint8_t *p = (const uint8_t *) w->pending;
+	size_t len = (size_t) w->num_pending * sizeof(struct ts_index_entry), done;
+	ssize_t n;
+
+	for( done = 0; done < len; done += n )
+	{
+		if( (n = write( w->fd, p + done, len - done )) < 0 )
+		{
+			if( errno == EINTR )
+			{
+				n = 0;
+				continue;
+			}
+			PERROR( "write of packet index failed" );
+			w->failed = 1;
+			return -1;
+		}
+	}
+
+	w->num_pending = 0;
+	return 0;
+}
+
+static int index_emit( struct ts_index_writer *w, int type, uint16_t pid, uint32_t count, uint64_t packet, uint64_t pcr )
+{
+	struct ts_index_entry *e;
+
+	if( w->num_pending == INDEX_BATCH && index_flush( w ) < 0 )
+		return -1;
+
+	e = &w->pending[w->num_pending++];
+	e->type   = type;
+	e->pid    = pid;
+	e->count  = count;
+	e->packet = packet;
+	e->pcr    = pcr;
+
+	return 0;
+}
+
+static int index_close_runs( struct ts_index_writer *w )
+{
+	struct index_pid *s;
+	int i;
+
+	for( i = 0; i < w->num_open; i++ )
+	{
+		s = &w->pid[w->open[i]];
+		if( index_emit( w, TS_INDEX_RANGE, w->open[i], s->last - s->first + 1, s->first, 0 ) < 0 )
+			return -1;
+		s->open = 0;
+	}
+
+	w->num_open = 0;
+	return 0;
+}
+
+static int index_sync( struct ts_index_writer *w )
+{
+	if( index_close_runs( w ) < 0 || index_emit( w, TS_INDEX_SYNC, TS_INDEX_NO_PID, 0, w->packets, 0 ) < 0 )
+		return -1;
+
+	w->next_sync += (uint64_t) w->block_packets * TS_INDEX_SYNC_BLOCKS;
+
+	return index_flush( w );
+}
+
+struct ts_index_writer *ts_index_create( const char *path, int block_packets )
+{
+	struct ts_index_writer *w;
+	struct ts_index_header hdr;
+
+	if( block_packets <= 0 )
+		block_packets = TS_INDEX_BLOCK_PACKETS;
+
+	if( (w = calloc( 1, sizeof(struct ts_index_writer) )) == NULL )
+		return NULL;
+
+	if( (w->fd = open( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 )) < 0 )
+	{
+		PERROR( "failed creating '%s'", path );
+		free( w );
+		return NULL;
+	}
+
+	memset( &hdr, 0, sizeof(hdr) );
+	memcpy( hdr.magic, TS_INDEX_MAGIC, sizeof(TS_INDEX_MAGIC) );
+	hdr.header_size   = sizeof(hdr);
+	hdr.entry_size    = sizeof(struct ts_index_entry);
+	hdr.packet_size   = TS_PACKET_SIZE;
+	hdr.block_packets = block_packets;
+
+	if( write( w->fd, &hdr, sizeof(hdr) ) != sizeof(hdr) )
+	{
+		PERROR( "write of '%s' failed", path );
+		close( w->fd );
+		free( w );
+		return NULL;
+	}
+
+	w->block_packets = block_packets;
+	w->next_sync     = (uint64_t) block_packets * TS_INDEX_SYNC_BLOCKS;
+
+	return w;
+}
+
+static void index_pcr( struct index_pid *s, uint64_t raw )
+{
+	uint64_t d;
+
+	if( !s->has_pcr )
+	{
+		s->pcr = raw;
+		s->has_pcr = 1;
+		return;
+	}
+
+	// -- Forward across the 26.5 h wrap; a jump back (splice, discontinuity) stays a jump back
+	d = (raw + TS_INDEX_PCR_WRAP - s->pcr % TS_INDEX_PCR_WRAP) % TS_INDEX_PCR_WRAP;
+
+	if( d < TS_INDEX_PCR_WRAP / 2 )
+		s->pcr += d;
+	else
+		s->pcr = s->pcr > TS_INDEX_PCR_WRAP - d ? s->pcr - (TS_INDEX_PCR_WRAP - d) : 0;
+}
+
+int ts_index_add( struct ts_index_writer *w, const struct ts_block *blk, const uint8_t *buf )
+{
+	struct index_pid *s;
+	uint64_t block;
+	uint16_t pid;
+	int i, first_pcr;
+
+	if( w->failed )
+		return -1;
+
+	for( i = 0; i < blk->count; i++, w->packets++ )
+	{
+		if( w->packets == w->next_sync && index_sync( w ) < 0 )
+			return -1;
+
+		block = w->packets / w->block_packets;
+		pid   = blk->pid[i];
+		s     = &w->pid[pid];
+
+		if( !s->open )
+		{
+			s->open  = 1;
+			s->first = block;
+			w->open[w->num_open++] = pid;
+		}
+		else if( s->last + 1 < block )
+		{
+			if( index_emit( w, TS_INDEX_RANGE, pid, s->last - s->first + 1, s->first, 0 ) < 0 )
+				return -1;
+			s->first = block;
+		}
+
+		s->last = block;
+
+		if( blk->flags[i] & TS_F_PCR )
+		{
+			first_pcr = !s->has_pcr;
+			index_pcr( s, ts_pcr( buf + blk->offset[i] ) );
+
+			if( first_pcr || s->pcr < s->pcr_logged || s->pcr - s->pcr_logged >= TS_INDEX_PCR_INTERVAL )
+			{
+				if( index_emit( w, TS_INDEX_PCR, pid, 0, w->packets, s->pcr ) < 0 )
+					return -1;
+				s->pcr_logged = s->pcr;
+			}
+		}
+
+		if( (blk->flags[i] & TS_F_RAI) && index_emit( w, TS_INDEX_RAP, pid, 0, w->packets, 0 ) < 0 )
+			return -1;
+	}
+
+	return 0;
+}
+
+uint64_t ts_index_packets( struct ts_index_writer *w )
+{
+	return w->packets;
+}
+
+int ts_index_close( struct ts_index_writer *w )
+{
+	int rc = 0;
+
+	if( w == NULL )
+		return 0;
+
+	if( !w->failed &&
+	    (index_close_runs( w ) < 0 || index_emit( w, TS_INDEX_END, TS_INDEX_NO_PID, 0, w->packets, 0 ) < 0 ||
+	     index_flush( w ) < 0) )
+		rc = -1;
+
+	if( w->failed )
+		rc = -1;
+
+	close( w->fd );
+	free( w );
+
+	return rc;
+}
+
+
+/*
+  ###############################################################
+  #    Reader                                                   #
+  ###############################################################
+*/
+struct ts_index *ts_index_open( const char *path )
+{
+	struct ts_index *idx;
+	struct ts_index_entry *e;
+	struct stat st;
+	uint8_t *buf;
+	size_t got = 0, i;
+	ssize_t n;
+	int fd;
+
+	if( (fd = open( path, O_RDONLY )) < 0 || fstat( fd, &st ) < 0 )
+	{
+		PERROR( "failed opening '%s'", path );
+		return NULL;
+	}
+
+	if( st.st_size < sizeof(struct ts_index_header) || (buf = malloc( st.st_size )) == NULL )
+	{
+		ERROR( "'%s' is not a packet index", path );
+		close( fd );
+		return NULL;
+	}
+
+	while( got < st.st_size && (n = read( fd, buf + got, st.st_size - got )) > 0 )
+		got += n;
+
+	close( fd );
+
+	if( (idx = calloc( 1, sizeof(struct ts_index) )) == NULL )
+	{
+		free( buf );
+		return NULL;
+	}
+
+	memcpy( &idx->hdr, buf, sizeof(idx->hdr) );
+
+	if( memcmp( idx->hdr.magic, TS_INDEX_MAGIC, sizeof(TS_INDEX_MAGIC) ) != 0 ||
+	    idx->hdr.entry_size != sizeof(struct ts_index_entry) || idx->hdr.packet_size != TS_PACKET_SIZE ||
+	    idx->hdr.block_packets == 0 || idx->hdr.header_size > got )
+	{
+		ERROR( "'%s' is not a packet index", path );
+		free( buf );
+		free( idx );
+		return NULL;
+	}
+
+	// -- A trailing partial entry is a recorder still writing, ignore it
+	idx->num_entries = (got - idx->hdr.header_size) / sizeof(struct ts_index_entry);
+	idx->entries = (struct ts_index_entry *) buf;
+	memmove( buf, buf + idx->hdr.header_size, idx->num_entries * sizeof(struct ts_index_entry) );
+
+	for( i = 0; i < idx->num_entries; i++ )
+	{
+		e = &idx->entries[i];
+
+		if( e->type == TS_INDEX_SYNC )
+			idx->covered = e->packet / idx->hdr.block_packets;
+		else if( e->type == TS_INDEX_END )
+		{
+			idx->packets  = e->packet;
+			idx->covered  = (e->packet + idx->hdr.block_packets - 1) / idx->hdr.block_packets;
+			idx->complete = 1;
+		}
+	}
+
+	return idx;
+}
+
+void ts_index_free( struct ts_index *idx )
+{
+	if( idx == NULL )
+		return;
+
+	free( idx->entries );
+	free( idx );
+}
+
+void ts_index_blocks( const struct ts_index *idx, const uint8_t *pids, uint64_t first, uint64_t last, uint8_t *map )
+{
+	const struct ts_index_entry *e;
+	uint64_t b, end;
+	size_t i;
+
+	memset( map, 0, last > first ? last - first : 0 );
+
+	for( i = 0; i < idx->num_entries; i++ )
+	{
+		e = &idx->entries[i];
+
+		if( e->type != TS_INDEX_RANGE || e->pid >= TS_INDEX_NUM_PIDS || !pids[e->pid] )
+			continue;
+
+		end = e->packet + e->count;
+		for( b = e->packet > first ? e->packet : first; b < end && b < last; b++ )
+			map[b - first] = 1;
+	}
+
+	// -- Nothing is known about what the recorder wrote after its last sync
+	for( b = idx->covered > first ? idx->covered : first; b < last; b++ )
+		map[b - first] = 1;
+}
+
+int64_t ts_index_seek( const struct ts_index *idx, uint16_t pcr_pid, uint16_t rap_pid, double seconds )
+{
+	const struct ts_index_entry *e, *first = NULL, *last = NULL, *prev;
+	uint64_t target = 0;
+	int64_t packet = -1;
+	int found = 0;
+	size_t i;
+
+	for( i = 0; i < idx->num_entries; i++ )
+	{
+		e = &idx->entries[i];
+
+		if( e->type != TS_INDEX_PCR || e->pid != pcr_pid )
+			continue;
+
+		if( !found )
+		{
+			target = e->pcr + (uint64_t) (seconds * 27000000.0);
+			first = e;
+			found = 1;
+		}
+
+		prev = last;
+		last = e;
+
+		if( e->pcr >= target )
+		{
+			// -- PCRs are logged up to 250 ms apart; place the target between the two
+			// -- around it, or the RAP lookup below can pick one after the requested start
+			packet = e->packet;
+			if( prev != NULL && e->pcr > prev->pcr )
+				packet = prev->packet + (int64_t) ((double) (target - prev->pcr) *
+					(e->packet - prev->packet) / (e->pcr - prev->pcr));
+			break;
+		}
+	}
+
+	if( !found )
+		return -1;
+
+	if( packet < 0 )
+	{
+		if( idx->complete || last->pcr <= first->pcr )
+			return idx->complete ? idx->packets : last->packet;
+
+		// -- Still recording: guess from the average rate so far, there are no RAPs that far anyway
+		return last->packet + (int64_t) ((double) (target - last->pcr) *
+			(last->packet - first->packet) / (last->pcr - first->pcr));
+	}
+
+	if( rap_pid == TS_INDEX_NO_PID )
+		return packet;
+
+	for( i = idx->num_entries; i-- > 0; )
+	{
+		e = &idx->entries[i];
+
+		if( e->type == TS_INDEX_RAP && e->pid == rap_pid && e->packet <= packet )
+			return e->packet;
+	}
+
+	return packet;
+}
@@ -0,0 +1,104 @@
+#ifndef _TS_INDEX_H_
+#define _TS_INDEX_H_
+/* ts_index.h -- sidecar packet index for transport stream recordings
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Written next to a recording (foo.ts -> foo.ts.idx) while it is being
+ * recorded, so one program or a stretch of time can be pulled out of a
+ * full mux later by reading only the parts of the file that hold it.
+ * The recording is cut into blocks of block_packets packets; recordings
+ * only ever contain whole packets back to back, so block b starts at
+ * byte b * block_packets * 188.
+ *
+ * After the header come fixed size entries in the order the writer
+ * completed them:
+ *
+ *	TS_INDEX_RANGE  pid is in blocks [packet, packet + count)
+ *	TS_INDEX_PCR    a PCR of pid (27 MHz, unwrapped to 64 bits) and the
+ *	                packet it was in, at most every TS_INDEX_PCR_INTERVAL
+ *	TS_INDEX_RAP    packet of pid with the random_access_indicator set
+ *	TS_INDEX_SYNC   every block before packet is fully described
+ *	TS_INDEX_END    the recording ended cleanly after packet packets
+ *
+ * Runs are closed and the entries flushed every TS_INDEX_SYNC_BLOCKS
+ * blocks, so a recording that is still going, or whose recorder died,
+ * has an index that is good up to its last sync; a reader has to treat
+ * the blocks after that as holding every PID.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ts_classify.h"
+
+#define TS_INDEX_MAGIC                  "TSIDX1"
+#define TS_INDEX_SUFFIX                   ".idx"
+#define TS_INDEX_BLOCK_PACKETS               256
+#define TS_INDEX_SYNC_BLOCKS                1024
+#define TS_INDEX_PCR_INTERVAL      (27000000 / 4)  /* 250 ms */
+#define TS_INDEX_PCR_WRAP            (300ULL << 33)
+#define TS_INDEX_NUM_PIDS                 0x2000
+#define TS_INDEX_NO_PID                   0xFFFF
+
+enum ts_index_type {
+	TS_INDEX_RANGE = 1,
+	TS_INDEX_PCR,
+	TS_INDEX_RAP,
+	TS_INDEX_SYNC,
+	TS_INDEX_END,
+};
+
+struct ts_index_header {
+	char     magic [8];
+	uint32_t header_size;
+	uint32_t entry_size;
+	uint32_t packet_size;
+	uint32_t block_packets;
+	uint64_t reserved;
+};
+
+struct ts_index_entry {
+	uint16_t type;
+	uint16_t pid;
+	uint32_t count;                   /* TS_INDEX_RANGE: blocks */
+	uint64_t packet;                  /* first block for TS_INDEX_RANGE, else a packet number */
+	uint64_t pcr;                     /* TS_INDEX_PCR */
+};
+
+struct ts_index_writer;
+
+/* What a reader gets: every entry, plus how far they can be trusted */
+struct ts_index {
+	struct ts_index_header hdr;
+	struct ts_index_entry *entries;
+	size_t   num_entries;
+	uint64_t covered;                 /* blocks fully described */
+	uint64_t packets;                 /* from TS_INDEX_END, 0 if the recording did not finish */
+	int      complete;
+};
+
+/* Writer: feed it every packet that goes into the recording, in order */
+extern struct ts_index_writer *ts_index_create( const char *path, int block_packets );
+extern int                     ts_index_add( struct ts_index_writer *w, const struct ts_block *blk, const uint8_t *buf );
+extern uint64_t                ts_index_packets( struct ts_index_writer *w );
+extern int                     ts_index_close( struct ts_index_writer *w );
+
+/* Reader */
+extern struct ts_index *ts_index_open( const char *path );
+extern void             ts_index_free( struct ts_index *idx );
+
+/* Set map[b] for every block in [first, last) that holds one of the PIDs
+ * with pids[pid] set, or that lies past what the index covers */
+extern void             ts_index_blocks( const struct ts_index *idx, const uint8_t *pids,
+					 uint64_t first, uint64_t last, uint8_t *map );
+
+/* Packet at seconds into the recording, interpolated between pcr_pid's
+ * logged PCRs, and then back to the random access point of rap_pid at or
+ * before it (TS_INDEX_NO_PID for none). -1 if pcr_pid has no PCRs. Past
+ * the last PCR gives the end of a finished recording, or an estimate at
+ * its average rate so far for one that is still going. */
+extern int64_t          ts_index_seek( const struct ts_index *idx, uint16_t pcr_pid, uint16_t rap_pid, double seconds );
+
+
+#endif /* _TS_INDEX_H_ */
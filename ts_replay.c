@@ -0,0 +1,677 @@
+/* ts_replay.c -- play captured transport streams back at their own pace
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Generates realistic TS load for recorders, analyzers and the gateway
+ * without an antenna. Each input is mapped once; its PCRs give every
+ * packet a send time (linear between PCRs, the last known rate across
+ * discontinuities and before the first one) and any number of streams
+ * replay it, looped if asked, to a file or FIFO, a UDP socket or a
+ * ts_ring in shared memory.
+ *
+ * A single timer thread (this one) wakes up every tick and, for every
+ * stream, writes all packets that have fallen due since the last tick
+ * in one go: one write(), one sendmmsg() of 7 packet datagrams or one
+ * ring append. Packets go out straight from the mapping. With -u there
+ * is no pacing at all, streams take turns writing as fast as they can.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <time.h>
+
+#include "common.h"
+#include "ts_classify.h"
+#include "ts_ring.h"
+
+#define TS_PER_DATAGRAM                        7
+#define BATCH_SIZE                            64  /* datagrams per sendmmsg() */
+#define DEFAULT_TICK_US                     2000
+#define DEFAULT_BITRATE                 19392658  /* ATSC 8VSB, for inputs without PCR */
+#define DEFAULT_RING_SIZE        (8 * 1024 * 1024)
+#define UNPACED_CHUNK                       2048  /* packets per stream per round with -u */
+#define START_DELAY_NS                  10000000
+#define MAX_PCR_GAP_NS                1000000000  /* larger PCR steps are discontinuities */
+#define PCR_WRAP               (300ULL << 33)
+#define MAX_STREAMS                          256
+
+struct anchor {
+	uint64_t index;                   /* packet */
+	uint64_t t_ns;                    /* its send time from the start of the file */
+};
+
+struct input {
+	const char *path;
+	uint8_t  *buf;
+	size_t   len;
+	size_t   map_len;
+	int      mapped;
+	uint64_t packets;
+
+	uint16_t pcr_pid;
+	int      num_pcrs;
+	struct anchor *anchors;
+	int      num_anchors;
+	uint64_t duration_ns;
+};
+
+enum output_type { OUT_FILE, OUT_UDP, OUT_RING };
+
+struct stream {
+	struct input *in;
+	enum output_type type;
+	char     target [256];
+
+	int      fd;
+	struct sockaddr_in addr;
+	struct ts_ring *ring;
+	struct iovec   iov [BATCH_SIZE];
+	struct mmsghdr msgs [BATCH_SIZE];
+
+	uint64_t next;                    /* packet to send next */
+	int      seg;                     /* anchor segment next is in */
+	uint64_t loop_base_ns;
+	int      loops;
+	int      done;
+
+	uint64_t packets;
+	uint64_t writes;
+	uint64_t errors;
+};
+
+static volatile sig_atomic_t running = 1;
+static int stdout_fd = STDOUT_FILENO;
+
+
+static uint64_t now_ns( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void stop( int sig )
+{
+	running = 0;
+}
+
+static int add_anchor( struct input *in, uint64_t index, uint64_t t_ns )
+{
+	struct anchor *a;
+
+	if( (in->num_anchors & 63) == 0 )
+	{
+		if( (a = realloc( in->anchors, (in->num_anchors + 64) * sizeof(struct anchor) )) == NULL )
+			return -1;
+		in->anchors = a;
+	}
+
+	in->anchors[in->num_anchors].index = index;
+	in->anchors[in->num_anchors].t_ns  = t_ns;
+	in->num_anchors++;
+
+	return 0;
+}
+
+/*
+  ###############################################################
+  #    Map an input and derive send times from its PCRs         #
+  ###############################################################
+*/
+static int input_load( struct input *in, const char *path, uint32_t bitrate )
+{
+	static struct ts_block blk;
+	struct stat st;
+	size_t pos, garbage = 0;
+	uint64_t index = 0, pcr, prev_pcr = 0, prev_index = 0, d;
+	double t = 0, rate, first_rate = 0, t0;
+	uint8_t *copy;
+	int fd, i;
+
+	memset( in, 0, sizeof(*in) );
+	in->path = path;
+
+	if( (fd = open( path, O_RDONLY )) < 0 || fstat( fd, &st ) < 0 )
+	{
+		PERROR( "failed opening '%s'", path );
+		return -1;
+	}
+
+	in->len = st.st_size;
+	if( in->len < TS_PACKET_SIZE ||
+	    (in->buf = mmap( NULL, in->len, PROT_READ, MAP_PRIVATE, fd, 0 )) == MAP_FAILED )
+	{
+		ERROR( "'%s' is not a transport stream", path );
+		close( fd );
+		return -1;
+	}
+
+	close( fd );
+	in->mapped = 1;
+	in->map_len = in->len;
+	madvise( in->buf, in->len, MADV_WILLNEED );
+
+	// -- Packet rate used before the first and across broken PCRs
+	rate = TS_PACKET_SIZE * 8 * 1e9 / bitrate;
+
+	for( pos = 0; in->len - pos >= TS_PACKET_SIZE; pos += blk.consumed )
+	{
+		ts_classify( in->buf + pos, in->len - pos, &blk );
+		garbage += blk.resync_bytes;
+
+		for( i = 0; i < blk.count; i++, index++ )
+		{
+			if( !(blk.flags[i] & TS_F_PCR) || (in->num_pcrs > 0 && blk.pid[i] != in->pcr_pid) )
+				continue;
+
+			pcr = ts_pcr( in->buf + pos + blk.offset[i] );
+
+			if( in->num_pcrs == 0 )
+				in->pcr_pid = blk.pid[i];
+			else
+			{
+				d = (pcr + PCR_WRAP - prev_pcr) % PCR_WRAP * 1000 / 27;
+
+				if( d == 0 || d > MAX_PCR_GAP_NS )
+					d = (index - prev_index) * rate;
+				else
+					rate = (double) d / (index - prev_index);
+
+				if( in->num_pcrs == 1 )
+					first_rate = rate;
+				t += d;
+			}
+
+			if( add_anchor( in, index, t ) < 0 )
+				return -1;
+
+			prev_pcr = pcr;
+			prev_index = index;
+			in->num_pcrs++;
+		}
+
+		if( blk.consumed == 0 )
+			break;
+	}
+
+	in->packets = index;
+
+	if( garbage > 0 )
+	{
+		// -- Replay clean packets only, so datagrams and ring slots stay aligned
+		printf( "%s: dropping %zu bytes of garbage\n", path, garbage );
+
+		if( (copy = malloc( in->packets * TS_PACKET_SIZE )) == NULL )
+			return -1;
+
+		for( pos = 0, index = 0; in->len - pos >= TS_PACKET_SIZE; pos += blk.consumed )
+		{
+			ts_classify( in->buf + pos, in->len - pos, &blk );
+			for( i = 0; i < blk.count; i++, index++ )
+				memcpy( copy + index * TS_PACKET_SIZE, in->buf + pos + blk.offset[i], TS_PACKET_SIZE );
+		}
+
+		munmap( in->buf, in->len );
+		in->buf = copy;
+		in->mapped = 0;
+	}
+
+	in->len = in->packets * TS_PACKET_SIZE;
+
+	if( in->packets == 0 )
+	{
+		ERROR( "'%s' has no transport packets", path );
+		return -1;
+	}
+
+	// -- Extend the PCR timeline to packet 0 and to the end of the file
+	if( in->num_anchors == 0 )
+	{
+		if( add_anchor( in, 0, 0 ) < 0 )
+			return -1;
+	}
+	else if( in->anchors[0].index > 0 )
+	{
+		if( first_rate == 0 )
+			first_rate = rate;
+
+		t0 = in->anchors[0].index * first_rate;
+		for( i = 0; i < in->num_anchors; i++ )
+			in->anchors[i].t_ns += t0;
+
+		if( add_anchor( in, 0, 0 ) < 0 )
+			return -1;
+
+		memmove( &in->anchors[1], &in->anchors[0], (in->num_anchors - 1) * sizeof(struct anchor) );
+		in->anchors[0].index = 0;
+		in->anchors[0].t_ns  = 0;
+	}
+
+	i = in->num_anchors - 1;
+	if( add_anchor( in, in->packets, in->anchors[i].t_ns + (in->packets - in->anchors[i].index) * rate ) < 0 )
+		return -1;
+
+	in->duration_ns = in->anchors[in->num_anchors - 1].t_ns;
+
+	printf( "%s: %llu packets, %d PCRs on PID 0x%04x, %.3f s, %.3f Mbit/s\n", path,
+		(unsigned long long) in->packets, in->num_pcrs, in->pcr_pid, in->duration_ns / 1e9,
+		in->packets * TS_PACKET_SIZE * 8 * 1e3 / in->duration_ns );
+
+	return 0;
+}
+
+/* Packets of one pass whose send time is at or before t */
+static uint64_t input_due( struct input *in, int *seg, double t )
+{
+	struct anchor *a, *b;
+	uint64_t n;
+
+	while( *seg + 2 < in->num_anchors && in->anchors[*seg + 1].t_ns <= t )
+		(*seg)++;
+
+	a = &in->anchors[*seg];
+	b = &in->anchors[*seg + 1];
+
+	if( t < a->t_ns )
+		return a->index;
+	if( t >= b->t_ns || b->t_ns == a->t_ns )
+		return b->index;
+
+	n = a->index + (uint64_t) ((t - a->t_ns) * (b->index - a->index) / (b->t_ns - a->t_ns)) + 1;
+
+	return n < b->index ? n : b->index;
+}
+
+
+/*
+  ###############################################################
+  #    Outputs: file/FIFO, UDP, shared memory ring              #
+  ###############################################################
+*/
+static int stream_open( struct stream *s, const char *spec, int index, size_t ring_size )
+{
+	char host[128], *colon;
+	const char *arg;
+	int port, one = 1;
+
+	if( strncmp( spec, "udp:", 4 ) == 0 )
+	{
+		s->type = OUT_UDP;
+		arg = spec + 4;
+	}
+	else if( strncmp( spec, "shm:", 4 ) == 0 )
+	{
+		s->type = OUT_RING;
+		arg = spec + 4;
+	}
+	else
+	{
+		s->type = OUT_FILE;
+		arg = strncmp( spec, "file:", 5 ) == 0 ? spec + 5 : spec;
+	}
+
+	if( s->type == OUT_UDP )
+	{
+		snprintf( host, sizeof(host), "%s", arg );
+		if( (colon = strrchr( host, ':' )) == NULL )
+		{
+			ERROR( "udp output needs host:port, got '%s'", arg );
+			return -1;
+		}
+
+		*colon = '\0';
+		port = atoi( colon + 1 ) + index;
+
+		memset( &s->addr, 0, sizeof(s->addr) );
+		s->addr.sin_family = AF_INET;
+		s->addr.sin_port   = htons( port );
+		if( inet_aton( host, &s->addr.sin_addr ) == 0 )
+		{
+			ERROR( "bad address '%s'", host );
+			return -1;
+		}
+
+		snprintf( s->target, sizeof(s->target), "udp:%s:%d", host, port );
+
+		if( (s->fd = socket( AF_INET, SOCK_DGRAM, 0 )) < 0 )
+		{
+			PERROR( "socket" );
+			return -1;
+		}
+
+		if( IN_MULTICAST( ntohl( s->addr.sin_addr.s_addr ) ) )
+			setsockopt( s->fd, IPPROTO_IP, IP_MULTICAST_TTL, &one, sizeof(one) );
+
+		return 0;
+	}
+
+	// -- %d in a path becomes the stream number
+	snprintf( s->target, sizeof(s->target), arg, index );
+
+	if( s->type == OUT_RING )
+	{
+		if( (s->ring = ts_ring_create( s->target, ring_size )) == NULL )
+			return -1;
+		return 0;
+	}
+
+	if( strcmp( s->target, "-" ) == 0 )
+	{
+		s->fd = dup( stdout_fd );
+		return 0;
+	}
+
+	printf( "opening %s (a FIFO waits for its reader)\n", s->target );
+	if( (s->fd = open( s->target, O_WRONLY | O_CREAT | O_TRUNC, 0644 )) < 0 )
+	{
+		PERROR( "failed opening '%s'", s->target );
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Write packets first..last-1, return how many went out. UDP keeps a
+ * short tail back for the next tick unless flush is set. */
+static uint64_t stream_send( struct stream *s, uint64_t first, uint64_t last, int flush )
+{
+	const uint8_t *p = s->in->buf + first * TS_PACKET_SIZE;
+	size_t len = (last - first) * TS_PACKET_SIZE, chunk;
+	uint64_t sent = 0, n;
+	ssize_t rc;
+	int count, i;
+
+	switch( s->type )
+	{
+	case OUT_FILE:
+		while( sent < len )
+		{
+			rc = write( s->fd, p + sent, len - sent );
+			if( rc < 0 && errno == EINTR )
+				continue;
+			if( rc < 0 )
+			{
+				s->errors++;
+				break;
+			}
+			sent += rc;
+			s->writes++;
+		}
+		// -- A reader that went away stops the stream, not the others
+		if( sent < len )
+			s->done = 1;
+		return last - first;
+
+	case OUT_RING:
+		for( ; sent < len; sent += chunk )
+		{
+			chunk = len - sent;
+			if( chunk > s->ring->hdr->size / 2 )
+				chunk = s->ring->hdr->size / 2 / TS_PACKET_SIZE * TS_PACKET_SIZE;
+
+			ts_ring_write( s->ring, p + sent, chunk );
+			s->writes++;
+		}
+		return last - first;
+
+	case OUT_UDP:
+		n = last - first;
+		if( !flush )
+			n -= n % TS_PER_DATAGRAM;
+
+		while( sent < n )
+		{
+			for( count = 0; count < BATCH_SIZE && sent + count * TS_PER_DATAGRAM < n; count++ )
+			{
+				i = n - sent - count * TS_PER_DATAGRAM;
+				s->iov[count].iov_base = (void *) (p + (sent + count * TS_PER_DATAGRAM) * TS_PACKET_SIZE);
+				s->iov[count].iov_len  = (i < TS_PER_DATAGRAM ? i : TS_PER_DATAGRAM) * TS_PACKET_SIZE;
+			}
+
+			rc = sendmmsg( s->fd, s->msgs, count, 0 );
+			s->writes++;
+
+			// -- Nobody listening is fine for a load generator; count it and move on
+			if( rc < count )
+				s->errors += count - (rc > 0 ? rc : 0);
+
+			sent += (uint64_t) count * TS_PER_DATAGRAM;
+		}
+		return n;
+	}
+
+	return 0;
+}
+
+/*###############################################################
+  #   Display usage and exit                                    #
+  ###############################################################*/
+void usage()
+{
+     fprintf( stdout, "usage: ts_replay [options] input.ts [input.ts ...]\n" );
+     fprintf( stdout, "  -o output         file:path, udp:host:port or shm:path [Default: file:-]\n" );
+     fprintf( stdout, "                    %%d in a path is the stream number, udp ports count up\n" );
+     fprintf( stdout, "  -n copies         streams per input [Default: 1]\n" );
+     fprintf( stdout, "  -s speed          multiple of real time [Default: 1.0]\n" );
+     fprintf( stdout, "  -u                unpaced, as fast as the outputs take it\n" );
+     fprintf( stdout, "  -l loops          passes over each input, 0 = forever [Default: 1]\n" );
+     fprintf( stdout, "  -t seconds        stop after this long\n" );
+     fprintf( stdout, "  -T usec           timer tick [Default: %d]\n", DEFAULT_TICK_US );
+     fprintf( stdout, "  -b bitrate        for inputs without PCR [Default: %d]\n", DEFAULT_BITRATE );
+     fprintf( stdout, "  -r bytes          ring size for shm: [Default: %d]\n", DEFAULT_RING_SIZE );
+     exit( 0 );
+}
+
+/*###############################################################
+  #  Main program Entry                                         #
+  ###############################################################*/
+int main( int argc, char *argv[] )
+{
+	static struct stream streams[MAX_STREAMS];
+	struct input *inputs;
+	struct stream *s;
+	struct timespec ts;
+	const char *output = "file:-";
+	double speed = 1.0, media, elapsed;
+	uint64_t start, now, next_tick, end = 0, due, late, max_late = 0, overruns = 0;
+	uint64_t ticks = 0, total = 0, sent;
+	unsigned tick_us = DEFAULT_TICK_US;
+	uint32_t bitrate = DEFAULT_BITRATE;
+	size_t ring_size = DEFAULT_RING_SIZE;
+	int num_inputs, num_streams, copies = 1, loops = 1, paced = 1, seconds = 0;
+	int active, c, i, j;
+
+	while( (c = getopt( argc, argv, "o:n:s:ul:t:T:b:r:h" )) != -1 )
+	{
+		switch( c )
+		{
+		case 'o': output = optarg; break;
+		case 'n': copies = atoi( optarg ); break;
+		case 's': speed = strtod( optarg, NULL ); break;
+		case 'u': paced = 0; break;
+		case 'l': loops = atoi( optarg ); break;
+		case 't': seconds = atoi( optarg ); break;
+		case 'T': tick_us = atoi( optarg ); break;
+		case 'b': bitrate = strtoul( optarg, NULL, 0 ); break;
+		case 'r': ring_size = strtoul( optarg, NULL, 0 ); break;
+		default:  usage();
+		}
+	}
+
+	num_inputs = argc - optind;
+	num_streams = num_inputs * copies;
+
+	if( num_inputs <= 0 || copies <= 0 || speed <= 0 || loops < 0 || tick_us == 0 || bitrate == 0 )
+		usage();
+
+	if( num_streams > MAX_STREAMS )
+	{
+		ERROR( "at most %d streams", MAX_STREAMS );
+		return -1;
+	}
+
+	// -- Progress goes to stderr when the stream itself goes to stdout
+	if( strcmp( output, "file:-" ) == 0 || strcmp( output, "-" ) == 0 )
+	{
+		stdout_fd = dup( STDOUT_FILENO );
+		dup2( STDERR_FILENO, STDOUT_FILENO );
+	}
+
+	if( (inputs = calloc( num_inputs, sizeof(struct input) )) == NULL )
+		return -1;
+
+	for( i = 0; i < num_inputs; i++ )
+	{
+		if( input_load( &inputs[i], argv[optind + i], bitrate ) < 0 )
+			return -1;
+	}
+
+	for( i = 0; i < num_streams; i++ )
+	{
+		s = &streams[i];
+		s->in = &inputs[i % num_inputs];
+
+		for( j = 0; j < BATCH_SIZE; j++ )
+		{
+			s->msgs[j].msg_hdr.msg_name    = &s->addr;
+			s->msgs[j].msg_hdr.msg_namelen = sizeof(s->addr);
+			s->msgs[j].msg_hdr.msg_iov     = &s->iov[j];
+			s->msgs[j].msg_hdr.msg_iovlen  = 1;
+		}
+
+		if( stream_open( s, output, i, ring_size ) < 0 )
+			return -1;
+	}
+
+	signal( SIGINT, stop );
+	signal( SIGTERM, stop );
+	signal( SIGPIPE, SIG_IGN );
+
+	printf( "%d streams to %s, %s\n", num_streams, output, paced ? "paced" : "unpaced" );
+
+	start = now_ns( ) + (paced ? START_DELAY_NS : 0);
+	next_tick = start;
+	if( seconds > 0 )
+		end = start + seconds * 1000000000ULL;
+
+	do
+	{
+		if( paced )
+		{
+			ts.tv_sec  = next_tick / 1000000000ULL;
+			ts.tv_nsec = next_tick % 1000000000ULL;
+			while( clock_nanosleep( CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL ) == EINTR && running )
+				;
+		}
+
+		now = now_ns( );
+		media = now > start ? (now - start) * speed : 0;
+		active = 0;
+
+		if( paced && now > next_tick )
+		{
+			late = now - next_tick;
+			if( late > max_late )
+				max_late = late;
+			if( late > tick_us * 1000ULL )
+				overruns++;
+		}
+
+		for( i = 0; i < num_streams; i++ )
+		{
+			s = &streams[i];
+
+			while( !s->done )
+			{
+				if( paced )
+					due = input_due( s->in, &s->seg, media - s->loop_base_ns );
+				else
+					due = s->next + UNPACED_CHUNK < s->in->packets ? s->next + UNPACED_CHUNK : s->in->packets;
+
+				if( due > s->next )
+				{
+					sent = stream_send( s, s->next, due, due == s->in->packets );
+					s->next    += sent;
+					s->packets += sent;
+				}
+
+				if( s->next < s->in->packets )
+					break;
+
+				// -- End of the input, go round again if we are looping
+				s->next = 0;
+				s->seg  = 0;
+				s->loop_base_ns += s->in->duration_ns;
+
+				if( loops > 0 && ++s->loops >= loops )
+					s->done = 1;
+
+				if( !paced )
+					break;
+			}
+
+			if( !s->done )
+				active++;
+		}
+
+		ticks++;
+		next_tick += tick_us * 1000ULL;
+
+		if( end && now >= end )
+			break;
+
+	} while( running && active > 0 );
+
+	elapsed = (now_ns( ) - start) / 1e9;
+
+	for( i = 0; i < num_streams; i++ )
+	{
+		s = &streams[i];
+		total += s->packets;
+
+		printf( "%-32s %10llu packets %6.1f Mbit/s %8llu writes %6llu errors %3d loops\n", s->target,
+			(unsigned long long) s->packets, s->packets * TS_PACKET_SIZE * 8 / elapsed / 1e6,
+			(unsigned long long) s->writes, (unsigned long long) s->errors, s->loops );
+
+		if( s->ring != NULL )
+			ts_ring_close( s->ring );
+		else
+			close( s->fd );
+	}
+
+	printf( "%.3f s, %llu packets, %.1f Mbit/s total, %llu ticks", elapsed, (unsigned long long) total,
+		total * TS_PACKET_SIZE * 8 / elapsed / 1e6, (unsigned long long) ticks );
+	if( paced )
+		printf( ", max tick lateness %.3f ms, %llu overruns", max_late / 1e6, (unsigned long long) overruns );
+	printf( "\n" );
+
+	for( i = 0; i < num_inputs; i++ )
+	{
+		if( inputs[i].mapped )
+			munmap( inputs[i].buf, inputs[i].map_len );
+		else
+			free( inputs[i].buf );
+		free( inputs[i].anchors );
+	}
+	free( inputs );
+
+	return 0;
+}
@@ -0,0 +1,717 @@
+/* ts_ring.c -- single writer transport stream ring in shared memory
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Overwrites are detected seqlock style: the writer moves reserve past
+ * the bytes it is about to write before touching them and head once
+ * they are done, readers compare their cursor against reserve after
+ * they have looked at the data.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <time.h>
+
+#include "common.h"
+#include "ts_ring.h"
+
+#define TS_PACKET_SIZE                       188
+#define SERVER_POLL_MS                       200  /* how often the server notices ts_ring_close() */
+
+
+static int futex( uint32_t *word, int op, uint32_t val, const struct timespec *timeout )
+{
+	return syscall( SYS_futex, word, op, val, timeout, NULL, 0 );
+}
+
+static uint64_t now_ms( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+
+	return (uint64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static struct ts_ring *ring_map( int fd, size_t map_size, int writer )
+{
+	struct ts_ring *ring;
+	void *p;
+
+	p = mmap( NULL, map_size, writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0 );
+	if( p == MAP_FAILED )
+	{
+		PERROR( "mmap of ts ring failed" );
+		close( fd );
+		return NULL;
+	}
+
+	if( (ring = calloc( 1, sizeof(struct ts_ring) )) == NULL )
+	{
+		munmap( p, map_size );
+		close( fd );
+		return NULL;
+	}
+
+	ring->hdr      = p;
+	ring->data     = (uint8_t *) p + TS_RING_HEADER_SIZE;
+	ring->map_size = map_size;
+	ring->fd       = fd;
+	ring->writer   = writer;
+	ring->slots_fd = -1;
+	ring->slot     = -1;
+	ring->sock     = -1;
+
+	return ring;
+}
+
+static int ring_map_slots( struct ts_ring *ring, int fd )
+{
+	void *p;
+
+	p = mmap( NULL, sizeof(struct ts_ring_slots), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+	if( p == MAP_FAILED )
+	{
+		PERROR( "mmap of ts ring slots failed" );
+		close( fd );
+		return -1;
+	}
+
+	ring->slots    = p;
+	ring->slots_fd = fd;
+
+	return 0;
+}
+
+/* Size of the data area if fd holds a ring, 0 if not */
+static uint64_t ring_probe( int fd )
+{
+	struct ts_ring_header hdr;
+	struct stat st;
+
+	if( fstat( fd, &st ) < 0 || st.st_size < TS_RING_HEADER_SIZE ||
+	    pread( fd, &hdr, sizeof(hdr), 0 ) != sizeof(hdr) ||
+	    memcmp( hdr.magic, TS_RING_MAGIC, sizeof(hdr.magic) ) != 0 ||
+	    hdr.header_size != TS_RING_HEADER_SIZE || hdr.packet_size != TS_PACKET_SIZE ||
+	    hdr.size == 0 || hdr.size % TS_RING_UNIT != 0 || TS_RING_HEADER_SIZE + hdr.size > st.st_size )
+		return 0;
+
+	return hdr.size;
+}
+
+static size_t ring_round( size_t size )
+{
+	size = (size + TS_RING_UNIT - 1) / TS_RING_UNIT * TS_RING_UNIT;
+
+	return size == 0 ? TS_RING_UNIT : size;
+}
+
+static struct ts_ring *ring_init( int fd, size_t size )
+{
+	struct ts_ring *ring;
+
+	if( ftruncate( fd, TS_RING_HEADER_SIZE + size ) < 0 )
+	{
+		PERROR( "failed sizing ts ring" );
+		close( fd );
+		return NULL;
+	}
+
+	if( (ring = ring_map( fd, TS_RING_HEADER_SIZE + size, 1 )) == NULL )
+		return NULL;
+
+	ring->hdr->header_size = TS_RING_HEADER_SIZE;
+	ring->hdr->packet_size = TS_PACKET_SIZE;
+	ring->hdr->size        = size;
+
+	// -- Readers check the magic first, so it goes in last
+	__atomic_thread_fence( __ATOMIC_RELEASE );
+	memcpy( ring->hdr->magic, TS_RING_MAGIC, sizeof(ring->hdr->magic) );
+
+	return ring;
+}
+
+
+/*
+  ###############################################################
+  #    Writer                                                   #
+  ###############################################################
+*/
+struct ts_ring *ts_ring_create( const char *path, size_t size )
+{
+	int fd;
+
+	if( (fd = open( path, O_RDWR | O_CREAT | O_TRUNC, 0644 )) < 0 )
+	{
+		PERROR( "failed creating '%s'", path );
+		return NULL;
+	}
+
+	return ring_init( fd, ring_round( size ) );
+}
+
+struct ts_ring *ts_ring_create_memfd( const char *name, size_t size, unsigned stall_ms )
+{
+	struct ts_ring *ring;
+	char slots_name[64];
+	int fd;
+
+	if( (fd = memfd_create( name, MFD_CLOEXEC | MFD_ALLOW_SEALING )) < 0 )
+	{
+		PERROR( "memfd_create" );
+		return NULL;
+	}
+
+	if( (ring = ring_init( fd, ring_round( size ) )) == NULL )
+		return NULL;
+
+	// -- Our mapping stays writable, nobody else gets one (older kernels lack the seal)
+#ifdef F_SEAL_FUTURE_WRITE
+	if( fcntl( fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_FUTURE_WRITE ) < 0 )
+		fcntl( fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW );
+#else
+	fcntl( fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW );
+#endif
+
+	snprintf( slots_name, sizeof(slots_name), "%s-slots", name );
+
+	if( (fd = memfd_create( slots_name, MFD_CLOEXEC )) < 0 ||
+	    ftruncate( fd, sizeof(struct ts_ring_slots) ) < 0 ||
+	    ring_map_slots( ring, fd ) < 0 )
+	{
+		PERROR( "ts ring slots" );
+		ts_ring_close( ring );
+		return NULL;
+	}
+
+	ring->stall_ms = stall_ms;
+
+	return ring;
+}
+
+/* Does writing up to end overwrite what a TS_RING_BLOCK reader still
+ * holds? One the writer already gave up on only counts again once it is
+ * back within a ring of head. */
+static int ring_blocks( struct ts_ring *ring, struct ts_ring_slot *s, uint64_t end )
+{
+	uint64_t cursor;
+
+	if( !__atomic_load_n( &s->in_use, __ATOMIC_ACQUIRE ) || s->policy != TS_RING_BLOCK )
+		return 0;
+
+	cursor = __atomic_load_n( &s->cursor, __ATOMIC_ACQUIRE );
+
+	if( s->stalled )
+	{
+		if( ring->hdr->head - cursor > ring->hdr->size )
+			return 0;
+		s->stalled = 0;
+	}
+
+	return end - cursor > ring->hdr->size;
+}
+
+/* Hold off until every TS_RING_BLOCK reader has released what writing
+ * up to end would overwrite, or the stall limit is up */
+static void ring_wait_readers( struct ts_ring *ring, uint64_t end )
+{
+	struct ts_ring_slots *slots = ring->slots;
+	struct ts_ring_slot *s;
+	struct timespec ts;
+	uint64_t deadline = 0, now;
+	uint32_t progress;
+	int i, blocked;
+
+	if( slots == NULL || ring->stall_ms == 0 )
+		return;
+
+	for( ;; )
+	{
+		progress = __atomic_load_n( &slots->progress, __ATOMIC_ACQUIRE );
+		blocked  = 0;
+
+		for( i = 0; i < TS_RING_MAX_READERS; i++ )
+			blocked += ring_blocks( ring, &slots->slot[i], end );
+
+		if( blocked == 0 )
+			break;
+
+		now = now_ms( );
+		if( deadline == 0 )
+			deadline = now + ring->stall_ms;
+
+		if( now >= deadline )
+		{
+			// -- One stall per lapse: from here on they get overwritten without a wait
+			for( i = 0; i < TS_RING_MAX_READERS; i++ )
+			{
+				s = &slots->slot[i];
+				if( ring_blocks( ring, s, end ) )
+				{
+					s->stalled = 1;
+					__atomic_add_fetch( &s->stalls, 1, __ATOMIC_RELAXED );
+				}
+			}
+			break;
+		}
+
+		__atomic_store_n( &slots->writer_waiting, 1, __ATOMIC_SEQ_CST );
+		ts.tv_sec  = (deadline - now) / 1000;
+		ts.tv_nsec = (deadline - now) % 1000 * 1000000L;
+		futex( &slots->progress, FUTEX_WAIT, progress, &ts );
+	}
+
+	__atomic_store_n( &slots->writer_waiting, 0, __ATOMIC_RELAXED );
+}
+
+uint8_t *ts_ring_reserve( struct ts_ring *ring, size_t *len )
+{
+	struct ts_ring_header *hdr = ring->hdr;
+	uint64_t head = hdr->head, end;
+	size_t pos, room;
+
+	// -- Never more than half the ring at once, so readers always have something left
+	pos  = head % hdr->size;
+	room = hdr->size - pos;
+	if( room > hdr->size / 2 )
+		room = hdr->size / 2;
+	if( *len > 0 && *len < room )
+		room = *len;
+
+	end = head + room;
+	ring_wait_readers( ring, end );
+
+	if( end > hdr->reserve )
+		__atomic_store_n( &hdr->reserve, end, __ATOMIC_RELAXED );
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+	*len = room;
+	return ring->data + pos;
+}
+
+void ts_ring_commit( struct ts_ring *ring, size_t len )
+{
+	struct ts_ring_header *hdr = ring->hdr;
+
+	len -= len % TS_PACKET_SIZE;
+	if( len == 0 )
+		return;
+
+	__atomic_store_n( &hdr->head, hdr->head + len, __ATOMIC_RELEASE );
+	__atomic_add_fetch( &hdr->seq, 1, __ATOMIC_RELEASE );
+	futex( &hdr->seq, FUTEX_WAKE, INT_MAX, NULL );
+}
+
+int ts_ring_write( struct ts_ring *ring, const uint8_t *packets, size_t len )
+{
+	uint8_t *p;
+	size_t n;
+
+	if( len % TS_PACKET_SIZE != 0 )
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	while( len > 0 )
+	{
+		n = len;
+		p = ts_ring_reserve( ring, &n );
+		memcpy( p, packets, n );
+		ts_ring_commit( ring, n );
+
+		packets += n;
+		len     -= n;
+	}
+
+	return 0;
+}
+
+
+/*
+  ###############################################################
+  #    Unix socket server: one slot per connection              #
+  ###############################################################
+*/
+static int send_slot( int sock, int32_t slot, int fd1, int fd2 )
+{
+	union { struct cmsghdr hdr; char buf[CMSG_SPACE(2 * sizeof(int))]; } ctl;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	int fds[2] = { fd1, fd2 };
+
+	memset( &msg, 0, sizeof(msg) );
+	iov.iov_base = &slot;
+	iov.iov_len  = sizeof(slot);
+	msg.msg_iov    = &iov;
+	msg.msg_iovlen = 1;
+
+	if( slot >= 0 )
+	{
+		memset( &ctl, 0, sizeof(ctl) );
+		msg.msg_control    = ctl.buf;
+		msg.msg_controllen = sizeof(ctl.buf);
+
+		cmsg = CMSG_FIRSTHDR( &msg );
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type  = SCM_RIGHTS;
+		cmsg->cmsg_len   = CMSG_LEN( sizeof(fds) );
+		memcpy( CMSG_DATA( cmsg ), fds, sizeof(fds) );
+	}
+
+	return sendmsg( sock, &msg, MSG_NOSIGNAL ) == sizeof(slot) ? 0 : -1;
+}
+
+static void free_slot( struct ts_ring *ring, int slot )
+{
+	struct ts_ring_slots *slots = ring->slots;
+
+	__atomic_store_n( &slots->slot[slot].in_use, 0, __ATOMIC_RELEASE );
+
+	// -- The writer may be waiting on this one
+	__atomic_add_fetch( &slots->progress, 1, __ATOMIC_RELEASE );
+	futex( &slots->progress, FUTEX_WAKE, INT_MAX, NULL );
+}
+
+static void *ring_server( void *arg )
+{
+	struct ts_ring *ring = arg;
+	struct ts_ring_slots *slots = ring->slots;
+	struct pollfd pfd[TS_RING_MAX_READERS + 1];
+	int conn_slot[TS_RING_MAX_READERS + 1];
+	uint32_t policy;
+	char c;
+	int n = 1, i, j, fd, slot;
+
+	pfd[0].fd = ring->sock;
+	pfd[0].events = POLLIN;
+
+	while( __atomic_load_n( &ring->serving, __ATOMIC_ACQUIRE ) )
+	{
+		if( poll( pfd, n, SERVER_POLL_MS ) <= 0 )
+			continue;
+
+		// -- A reader going away frees its slot
+		for( i = 1; i < n; i++ )
+		{
+			if( pfd[i].revents == 0 || read( pfd[i].fd, &c, 1 ) > 0 )
+				continue;
+
+			free_slot( ring, conn_slot[i] );
+			close( pfd[i].fd );
+
+			pfd[i] = pfd[n - 1];
+			conn_slot[i] = conn_slot[n - 1];
+			n--;
+			i--;
+		}
+
+		if( !(pfd[0].revents & POLLIN) || (fd = accept4( ring->sock, NULL, NULL, SOCK_CLOEXEC )) < 0 )
+			continue;
+
+		slot = -1;
+		if( read( fd, &policy, sizeof(policy) ) == sizeof(policy) )
+		{
+			for( j = 0; j < TS_RING_MAX_READERS && slot < 0; j++ )
+			{
+				if( !slots->slot[j].in_use )
+					slot = j;
+			}
+		}
+
+		if( slot < 0 || n > TS_RING_MAX_READERS )
+		{
+			send_slot( fd, -1, -1, -1 );
+			close( fd );
+			continue;
+		}
+
+		memset( &slots->slot[slot], 0, sizeof(struct ts_ring_slot) );
+		slots->slot[slot].policy = policy == TS_RING_BLOCK ? TS_RING_BLOCK : TS_RING_DROP;
+		slots->slot[slot].cursor = ts_ring_head( ring );
+		__atomic_store_n( &slots->slot[slot].in_use, 1, __ATOMIC_RELEASE );
+
+		if( send_slot( fd, slot, ring->fd, ring->slots_fd ) < 0 )
+		{
+			free_slot( ring, slot );
+			close( fd );
+			continue;
+		}
+
+		pfd[n].fd      = fd;
+		pfd[n].events  = POLLIN;
+		conn_slot[n]   = slot;
+		n++;
+	}
+
+	for( i = 1; i < n; i++ )
+		close( pfd[i].fd );
+
+	return NULL;
+}
+
+int ts_ring_serve( struct ts_ring *ring, const char *socket_path )
+{
+	struct sockaddr_un addr;
+	int rc;
+
+	if( ring->slots == NULL || strlen( socket_path ) >= sizeof(addr.sun_path) )
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	strcpy( addr.sun_path, socket_path );
+
+	if( (ring->sock = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 )) < 0 )
+		return -1;
+
+	unlink( socket_path );
+
+	if( bind( ring->sock, (struct sockaddr *) &addr, sizeof(addr) ) < 0 || listen( ring->sock, 8 ) < 0 )
+	{
+		close( ring->sock );
+		ring->sock = -1;
+		return -1;
+	}
+
+	strcpy( ring->sock_path, socket_path );
+	ring->serving = 1;
+
+	if( (rc = pthread_create( &ring->server, NULL, ring_server, ring )) != 0 )
+	{
+		ring->serving = 0;
+		errno = rc;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/*
+  ###############################################################
+  #    Reader                                                   #
+  ###############################################################
+*/
+struct ts_ring *ts_ring_attach( const char *path )
+{
+	uint64_t size;
+	int fd;
+
+	if( (fd = open( path, O_RDONLY )) < 0 )
+	{
+		PERROR( "failed opening '%s'", path );
+		return NULL;
+	}
+
+	if( (size = ring_probe( fd )) == 0 )
+	{
+		ERROR( "'%s' is not a ts ring", path );
+		close( fd );
+		return NULL;
+	}
+
+	return ring_map( fd, TS_RING_HEADER_SIZE + size, 0 );
+}
+
+struct ts_ring *ts_ring_connect( const char *socket_path, enum ts_ring_policy policy )
+{
+	union { struct cmsghdr hdr; char buf[CMSG_SPACE(2 * sizeof(int))]; } ctl;
+	struct sockaddr_un addr;
+	struct ts_ring *ring;
+	struct msghdr msg;
+	struct cmsghdr *cmsg;
+	struct iovec iov;
+	uint32_t p = policy;
+	uint64_t size;
+	int32_t slot = -1;
+	int sock, fds[2];
+
+	memset( &addr, 0, sizeof(addr) );
+	addr.sun_family = AF_UNIX;
+	snprintf( addr.sun_path, sizeof(addr.sun_path), "%s", socket_path );
+
+	if( (sock = socket( AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0 )) < 0 ||
+	    connect( sock, (struct sockaddr *) &addr, sizeof(addr) ) < 0 ||
+	    write( sock, &p, sizeof(p) ) != sizeof(p) )
+	{
+		PERROR( "failed connecting to '%s'", socket_path );
+		if( sock >= 0 )
+			close( sock );
+		return NULL;
+	}
+
+	memset( &msg, 0, sizeof(msg) );
+	iov.iov_base = &slot;
+	iov.iov_len  = sizeof(slot);
+	msg.msg_iov        = &iov;
+	msg.msg_iovlen     = 1;
+	msg.msg_control    = ctl.buf;
+	msg.msg_controllen = sizeof(ctl.buf);
+
+	if( recvmsg( sock, &msg, MSG_CMSG_CLOEXEC ) != sizeof(slot) || slot < 0 ||
+	    (cmsg = CMSG_FIRSTHDR( &msg )) == NULL || cmsg->cmsg_type != SCM_RIGHTS ||
+	    cmsg->cmsg_len != CMSG_LEN( sizeof(fds) ) )
+	{
+		ERROR( "'%s' has no reader slot for us", socket_path );
+		close( sock );
+		return NULL;
+	}
+
+	memcpy( fds, CMSG_DATA( cmsg ), sizeof(fds) );
+
+	if( (size = ring_probe( fds[0] )) == 0 || (ring = ring_map( fds[0], TS_RING_HEADER_SIZE + size, 0 )) == NULL )
+	{
+		ERROR( "'%s' sent something that is not a ts ring", socket_path );
+		close( fds[1] );
+		close( sock );
+		return NULL;
+	}
+
+	ring->sock = sock;
+	ring->slot = slot;
+
+	if( ring_map_slots( ring, fds[1] ) < 0 )
+	{
+		ts_ring_close( ring );
+		return NULL;
+	}
+
+	ts_ring_release( ring, ts_ring_head( ring ) );
+
+	return ring;
+}
+
+uint64_t ts_ring_head( struct ts_ring *ring )
+{
+	return __atomic_load_n( &ring->hdr->head, __ATOMIC_ACQUIRE );
+}
+
+size_t ts_ring_peek( struct ts_ring *ring, uint64_t *cursor, const uint8_t **data, uint64_t *dropped )
+{
+	uint64_t head = ts_ring_head( ring ), size = ring->hdr->size, next;
+	size_t pos, len;
+
+	if( __atomic_load_n( &ring->hdr->reserve, __ATOMIC_ACQUIRE ) - *cursor > size )
+	{
+		// -- Lapped: skip to half a ring behind the writer to get some slack back
+		next = head - size / 2;
+		next -= next % TS_PACKET_SIZE;
+
+		if( dropped != NULL )
+			*dropped += next - *cursor;
+		if( ring->slots != NULL && ring->slot >= 0 )
+			__atomic_add_fetch( &ring->slots->slot[ring->slot].dropped, next - *cursor, __ATOMIC_RELAXED );
+		*cursor = next;
+	}
+
+	pos = *cursor % size;
+	len = head - *cursor;
+	if( len > size - pos )
+		len = size - pos;
+
+	*data = ring->data + pos;
+
+	return len;
+}
+
+int ts_ring_check( struct ts_ring *ring, uint64_t cursor, size_t len )
+{
+	// -- Order our reads of the data before the look at reserve
+	__atomic_thread_fence( __ATOMIC_SEQ_CST );
+
+	return __atomic_load_n( &ring->hdr->reserve, __ATOMIC_RELAXED ) - cursor > ring->hdr->size ? -1 : 0;
+}
+
+void ts_ring_release( struct ts_ring *ring, uint64_t cursor )
+{
+	struct ts_ring_slots *slots = ring->slots;
+
+	if( slots == NULL || ring->slot < 0 )
+		return;
+
+	__atomic_store_n( &slots->slot[ring->slot].cursor, cursor, __ATOMIC_RELEASE );
+
+	if( slots->slot[ring->slot].policy == TS_RING_BLOCK )
+	{
+		__atomic_add_fetch( &slots->progress, 1, __ATOMIC_SEQ_CST );
+		if( __atomic_load_n( &slots->writer_waiting, __ATOMIC_SEQ_CST ) )
+			futex( &slots->progress, FUTEX_WAKE, 1, NULL );
+	}
+}
+
+int ts_ring_wait( struct ts_ring *ring, uint64_t cursor, int timeout_ms )
+{
+	struct ts_ring_header *hdr = ring->hdr;
+	struct timespec ts;
+	uint32_t seq;
+
+	seq = __atomic_load_n( &hdr->seq, __ATOMIC_ACQUIRE );
+
+	if( ts_ring_head( ring ) != cursor )
+		return 1;
+
+	if( __atomic_load_n( &hdr->closed, __ATOMIC_ACQUIRE ) )
+		return -1;
+
+	ts.tv_sec  = timeout_ms / 1000;
+	ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+	futex( &hdr->seq, FUTEX_WAIT, seq, timeout_ms < 0 ? NULL : &ts );
+
+	if( ts_ring_head( ring ) != cursor )
+		return 1;
+
+	return __atomic_load_n( &hdr->closed, __ATOMIC_ACQUIRE ) ? -1 : 0;
+}
+
+void ts_ring_close( struct ts_ring *ring )
+{
+	if( ring == NULL )
+		return;
+
+	if( ring->writer )
+	{
+		__atomic_store_n( &ring->hdr->closed, 1, __ATOMIC_RELEASE );
+		__atomic_add_fetch( &ring->hdr->seq, 1, __ATOMIC_RELEASE );
+		futex( &ring->hdr->seq, FUTEX_WAKE, INT_MAX, NULL );
+	}
+
+	if( ring->serving )
+	{
+		__atomic_store_n( &ring->serving, 0, __ATOMIC_RELEASE );
+		pthread_join( ring->server, NULL );
+		unlink( ring->sock_path );
+	}
+
+	if( ring->sock >= 0 )
+		close( ring->sock );
+
+	if( ring->slots != NULL )
+	{
+		munmap( ring->slots, sizeof(struct ts_ring_slots) );
+		close( ring->slots_fd );
+	}
+
+	munmap( ring->hdr, ring->map_size );
+	close( ring->fd );
+	free( ring );
+}
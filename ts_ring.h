@@ -0,0 +1,132 @@
+#ifndef _TS_RING_H_
+#define _TS_RING_H_
+/* ts_ring.h -- single writer transport stream ring in shared memory
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * One page of header followed by the data area, mapped MAP_SHARED by a
+ * writer and any number of readers. The data area is a whole number of
+ * pages and of 188 byte packets, and the writer only ever appends whole
+ * packets, so no packet straddles the wrap and readers can work on them
+ * in place.
+ *
+ * head counts every byte ever written, reserve every byte written or
+ * about to be; readers keep their own 64 bit cursor. A reader that falls
+ * more than the ring size behind reserve has been lapped: ts_ring_peek()
+ * moves its cursor forward and reports the bytes it lost. Data handed
+ * out by ts_ring_peek() can be overwritten while the reader is still on
+ * it, so ts_ring_check() afterwards says whether it was intact.
+ *
+ *	uint64_t cur = ts_ring_head( ring ), lost = 0;
+ *	while( ts_ring_wait( ring, cur, 1000 ) >= 0 )
+ *		while( (n = ts_ring_peek( ring, &cur, &p, &lost )) > 0 ) {
+ *			consume( p, n );
+ *			if( ts_ring_check( ring, cur, n ) < 0 ) ...
+ *			cur += n;
+ *			ts_ring_release( ring, cur );
+ *		}
+ *
+ * A ring can live in a file (ts_ring_create/ts_ring_attach) or in a
+ * memfd handed out over a unix socket (ts_ring_serve/ts_ring_connect).
+ * The latter also gives every reader a slot in a small shared table
+ * where ts_ring_release() publishes its cursor. Readers that connect
+ * with TS_RING_BLOCK hold the writer back until they have released the
+ * space it needs, for at most the writer's stall limit; after that it
+ * overwrites them like everybody else, and does not wait for them again
+ * until they are back within a ring of head. The data memfd is sealed against
+ * new writable mappings, the slot table is not (readers are trusted not
+ * to scribble on each other's slots).
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define TS_RING_MAGIC                  "TSRING1"
+#define TS_RING_HEADER_SIZE                 4096
+#define TS_RING_UNIT                 (4096 * 47)  /* whole pages and whole 188 byte packets */
+#define TS_RING_MAX_READERS                   32
+
+enum ts_ring_policy {
+	TS_RING_DROP,                     /* get lapped and count the loss */
+	TS_RING_BLOCK,                    /* make the writer wait */
+};
+
+struct ts_ring_header {
+	char     magic [8];
+	uint32_t header_size;
+	uint32_t packet_size;
+	uint64_t size;                    /* of the data area */
+
+	uint64_t head;                    /* bytes written so far */
+	uint64_t reserve;                 /* bytes written or being written */
+	uint32_t seq;                     /* bumped on every write, readers futex-wait on it */
+	uint32_t closed;                  /* writer has gone away */
+};
+
+struct ts_ring_slot {
+	uint32_t in_use;
+	uint32_t policy;
+	uint64_t cursor;                  /* released up to here */
+	uint64_t dropped;                 /* bytes lost to being lapped */
+	uint64_t stalls;                  /* times the writer gave up waiting for it */
+	uint32_t stalled;                 /* writer gave up, treated as TS_RING_DROP until it catches up */
+};
+
+struct ts_ring_slots {
+	uint32_t progress;                /* bumped on release, the writer futex-waits on it */
+	uint32_t writer_waiting;
+	struct ts_ring_slot slot [TS_RING_MAX_READERS];
+};
+
+struct ts_ring {
+	struct ts_ring_header *hdr;
+	uint8_t *data;
+	size_t   map_size;
+	int      fd;
+	int      writer;
+
+	struct ts_ring_slots *slots;      /* NULL for file backed rings */
+	int      slots_fd;
+	int      slot;                    /* ours, readers only */
+	unsigned stall_ms;                /* writer: longest wait for a TS_RING_BLOCK reader */
+
+	int      sock;                    /* writer: listening, reader: its connection */
+	int      serving;
+	char     sock_path [108];
+	pthread_t server;
+};
+
+/* Writer: create (or truncate) a ring file, or an anonymous one, size
+ * rounded up to TS_RING_UNIT */
+extern struct ts_ring *ts_ring_create( const char *path, size_t size );
+extern struct ts_ring *ts_ring_create_memfd( const char *name, size_t size, unsigned stall_ms );
+extern int             ts_ring_write( struct ts_ring *ring, const uint8_t *packets, size_t len );
+
+/* Writer, zero copy: space to fill at head (at most *len, 0 = as much
+ * as fits before the wrap), then publish len bytes of it. Only whole
+ * packets are published; a partial one stays in place as the start of
+ * the next reserve. Reserving is where TS_RING_BLOCK readers can stall
+ * the writer. */
+extern uint8_t        *ts_ring_reserve( struct ts_ring *ring, size_t *len );
+extern void            ts_ring_commit( struct ts_ring *ring, size_t len );
+
+/* Writer: hand the ring out to readers connecting on a unix socket */
+extern int             ts_ring_serve( struct ts_ring *ring, const char *socket_path );
+
+/* Reader: map an existing ring read only */
+extern struct ts_ring *ts_ring_attach( const char *path );
+extern struct ts_ring *ts_ring_connect( const char *socket_path, enum ts_ring_policy policy );
+extern uint64_t        ts_ring_head( struct ts_ring *ring );
+extern size_t          ts_ring_peek( struct ts_ring *ring, uint64_t *cursor, const uint8_t **data, uint64_t *dropped );
+extern int             ts_ring_check( struct ts_ring *ring, uint64_t cursor, size_t len );
+extern void            ts_ring_release( struct ts_ring *ring, uint64_t cursor );
+
+/* 1 when there is data past cursor, 0 on timeout, -1 once the writer closed */
+extern int             ts_ring_wait( struct ts_ring *ring, uint64_t cursor, int timeout_ms );
+
+/* A writer marks the ring closed, so readers see -1 from ts_ring_wait() */
+extern void            ts_ring_close( struct ts_ring *ring );
+
+
+#endif /* _TS_RING_H_ */
@@ -0,0 +1,525 @@
+/* ts_store.c -- recorder storage: preallocated segments, direct writes
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Everything that reaches the disk goes through store_flush(), a whole
+ * number of TS_STORE_UNITs at a time, so with O_DIRECT both the buffer
+ * and the file offset are always page aligned. Only the last write of a
+ * file can be short; O_DIRECT is switched off on the descriptor for it.
+ */
+
+#define _GNU_SOURCE
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <ctype.h>
+#include <time.h>
+
+#include "common.h"
+#include "ts_store.h"
+
+#define STORE_ALIGN                         4096
+#define STORE_EXT_SIZE                        32
+#define STORE_SEGMENT_DIGITS                   4
+
+struct ts_store {
+	struct ts_store_options opt;
+	enum ts_store_mode mode;          /* opt.mode unless O_DIRECT was refused */
+	char     base [PATH_MAX - 48];    /* path up to its extension, room left for .NNNN.ext */
+	char     ext [STORE_EXT_SIZE];
+	char     dir [PATH_MAX];
+	char     path [PATH_MAX];         /* of the current segment */
+	int      segment;
+	int      oldest;                  /* first segment of ours still on disk */
+
+	int      fd;
+	uint64_t written;                 /* bytes in the current file */
+	uint64_t allocated;               /* reserved with fallocate() */
+	uint64_t window;                  /* sync_file_range(): start of the window being filled */
+	uint64_t prev_window;             /* and of the one before it */
+	int      has_prev;
+
+	uint8_t *stage;
+	size_t   staged;
+
+	struct ts_store_stats stats;
+};
+
+
+static uint64_t now_us( void )
+{
+	struct timespec ts;
+
+	clock_gettime( CLOCK_MONOTONIC, &ts );
+	return (uint64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+void ts_store_default_options( struct ts_store_options *opt )
+{
+	memset( opt, 0, sizeof(*opt) );
+
+	opt->segment_size = (uint64_t) TS_STORE_UNIT * 5578;   /* ~1 GB */
+	opt->mode         = TS_STORE_DIRECT;
+	opt->min_free     = 512ULL * 1024 * 1024;
+}
+
+/* mux.ts -> .ts, the segment number goes in front of it */
+static const char *store_ext( const char *path )
+{
+	const char *slash = strrchr( path, '/' ), *dot = strrchr( path, '.' );
+
+	if( dot == NULL || (slash != NULL && dot < slash) || dot == path || strlen( dot ) >= STORE_EXT_SIZE )
+		return path + strlen( path );
+
+	return dot;
+}
+
+int ts_store_segment_name( const char *path, int segment, char *name, size_t size )
+{
+	const char *ext = store_ext( path );
+	int n;
+
+	n = snprintf( name, size, "%.*s.%0*d%s", (int) (ext - path), path, STORE_SEGMENT_DIGITS, segment, ext );
+
+	return n < 0 || (size_t) n >= size ? -1 : 0;
+}
+
+int ts_store_segment_number( const char *path, const char *name )
+{
+	const char *ext = store_ext( path ), *digits;
+	size_t base = ext - path, ext_len = strlen( ext ), len = strlen( name ), i;
+	long n;
+
+	if( len < base + 1 + STORE_SEGMENT_DIGITS + ext_len || strncmp( name, path, base ) != 0 ||
+	    name[base] != '.' || strcmp( name + len - ext_len, ext ) != 0 )
+		return -1;
+
+	digits = name + base + 1;
+	for( i = 0; digits + i < name + len - ext_len; i++ )
+	{
+		if( !isdigit( (unsigned char) digits[i] ) || i > 9 )
+			return -1;
+	}
+
+	n = strtol( digits, NULL, 10 );
+
+	return n > INT_MAX ? -1 : (int) n;
+}
+
+static void store_segment_path( struct ts_store *st, int segment, char *path )
+{
+	if( st->opt.segment_size == 0 )
+		snprintf( path, PATH_MAX, "%s%s", st->base, st->ext );
+	else
+		snprintf( path, PATH_MAX, "%s.%0*d%s", st->base, STORE_SEGMENT_DIGITS, segment, st->ext );
+}
+
+static void store_remove( struct ts_store *st, int segment )
+{
+	char path[PATH_MAX + 32];
+
+	store_segment_path( st, segment, path );
+	unlink( path );
+
+	if( st->opt.sidecar != NULL )
+	{
+		strcat( path, st->opt.sidecar );
+		unlink( path );
+	}
+}
+
+/*
+  ###############################################################
+  #    Free space: rotate or refuse before we start writing     #
+  ###############################################################
+*/
+static int store_guard( struct ts_store *st, uint64_t need )
+{
+	struct statfs fs;
+
+	for( ;; )
+	{
+		if( statfs( st->dir, &fs ) < 0 )
+		{
+			PERROR( "statfs '%s' failed", st->dir );
+			return -1;
+		}
+
+		st->stats.free_bytes = (uint64_t) fs.f_bavail * fs.f_bsize;
+
+		if( st->stats.free_bytes >= need + st->opt.min_free )
+			return 0;
+
+		if( !st->opt.rotate || st->oldest >= st->segment )
+		{
+			ERROR( "%.1f MB free on '%s', %.1f MB more would leave less than %.1f MB: refusing to record",
+			       st->stats.free_bytes / 1e6, st->dir, need / 1e6, st->opt.min_free / 1e6 );
+			errno = ENOSPC;
+			return -1;
+		}
+
+		store_remove( st, st->oldest++ );
+		st->stats.removed++;
+	}
+}
+
+static int store_reserve( struct ts_store *st, uint64_t end )
+{
+	if( store_guard( st, end - st->allocated ) < 0 )
+		return -1;
+
+	// -- KEEP_SIZE: the file only looks as long as what is in it, ts_extract can follow it
+	if( st->stats.preallocated &&
+	    fallocate( st->fd, FALLOC_FL_KEEP_SIZE, st->allocated, end - st->allocated ) < 0 )
+	{
+		if( errno != EOPNOTSUPP )
+		{
+			PERROR( "fallocate of '%s' failed", st->path );
+			return -1;
+		}
+		st->stats.preallocated = 0;
+	}
+
+	st->allocated = end;
+
+	return 0;
+}
+
+/*
+  ###############################################################
+  #    Push a window out, drop the one before from the cache    #
+  ###############################################################
+*/
+static void store_writeback( struct ts_store *st )
+{
+	if( st->written - st->window < TS_STORE_WINDOW )
+		return;
+
+	sync_file_range( st->fd, st->window, st->written - st->window, SYNC_FILE_RANGE_WRITE );
+
+	if( st->has_prev )
+	{
+		sync_file_range( st->fd, st->prev_window, st->window - st->prev_window,
+				 SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER );
+		posix_fadvise( st->fd, st->prev_window, st->window - st->prev_window, POSIX_FADV_DONTNEED );
+	}
+
+	st->prev_window = st->window;
+	st->has_prev    = 1;
+	st->window      = st->written;
+}
+
+static int store_flush( struct ts_store *st )
+{
+	uint64_t t;
+	ssize_t n;
+	size_t done;
+	int b;
+
+	if( st->staged == 0 )
+		return 0;
+
+	// -- One file mode reserves as it goes
+	while( st->written + st->staged > st->allocated )
+	{
+		if( store_reserve( st, st->allocated + TS_STORE_GROW ) < 0 )
+			return -1;
+	}
+
+	if( st->mode == TS_STORE_DIRECT && st->staged % STORE_ALIGN != 0 )
+		fcntl( st->fd, F_SETFL, fcntl( st->fd, F_GETFL ) & ~O_DIRECT );
+
+	t = now_us( );
+
+	for( done = 0; done < st->staged; done += n )
+	{
+		if( (n = write( st->fd, st->stage + done, st->staged - done )) < 0 )
+		{
+			if( errno == EINTR )
+			{
+				n = 0;
+				continue;
+			}
+			PERROR( "write of '%s' failed", st->path );
+			return -1;
+		}
+	}
+
+	st->written += st->staged;
+	st->staged = 0;
+
+	if( st->mode == TS_STORE_SYNC_RANGE )
+		store_writeback( st );
+
+	t = now_us( ) - t;
+
+	for( b = 0; b < TS_STORE_LATENCY_BUCKETS - 1 && (t >> b) > 1; b++ )
+		;
+
+	st->stats.latency[b]++;
+	st->stats.writes++;
+	st->stats.write_us += t;
+	if( t > st->stats.max_us )
+		st->stats.max_us = t;
+
+	return 0;
+}
+
+/*
+  ###############################################################
+  #    Segments                                                 #
+  ###############################################################
+*/
+static int store_open_segment( struct ts_store *st )
+{
+	int flags = O_WRONLY | O_CREAT | O_TRUNC;
+
+	store_segment_path( st, st->segment, st->path );
+
+	st->fd = open( st->path, flags | (st->mode == TS_STORE_DIRECT ? O_DIRECT : 0), 0644 );
+
+	if( st->fd < 0 && errno == EINVAL && st->mode == TS_STORE_DIRECT )
+	{
+		// -- tmpfs and friends: page cache it is, but still kept in check
+		st->mode = TS_STORE_SYNC_RANGE;
+		st->fd = open( st->path, flags, 0644 );
+	}
+
+	if( st->fd < 0 )
+	{
+		PERROR( "failed creating '%s'", st->path );
+		return -1;
+	}
+
+	memset( &st->stats, 0, sizeof(st->stats) );
+	memcpy( st->stats.path, st->path, sizeof(st->stats.path) );
+	st->stats.segment      = st->segment;
+	st->stats.mode         = st->mode;
+	st->stats.preallocated = 1;
+	st->stats.start_us     = now_us( );
+
+	st->written   = 0;
+	st->allocated = 0;
+	st->window    = 0;
+	st->has_prev  = 0;
+
+	return store_reserve( st, st->opt.segment_size ? st->opt.segment_size : TS_STORE_GROW );
+}
+
+static int store_close_segment( struct ts_store *st, int report )
+{
+	int rc = 0;
+
+	if( store_flush( st ) < 0 )
+		rc = -1;
+
+	if( st->mode != TS_STORE_BUFFERED && fdatasync( st->fd ) < 0 )
+	{
+		PERROR( "fdatasync of '%s' failed", st->path );
+		rc = -1;
+	}
+
+	if( st->mode == TS_STORE_SYNC_RANGE )
+		posix_fadvise( st->fd, 0, 0, POSIX_FADV_DONTNEED );
+
+	// -- Give back what was reserved and never written
+	if( st->allocated > st->written && ftruncate( st->fd, st->written ) < 0 )
+		PERROR( "ftruncate of '%s' failed", st->path );
+
+	close( st->fd );
+	st->fd = -1;
+
+	st->stats.bytes  = st->written;
+	st->stats.end_us = now_us( );
+
+	if( report && st->opt.segment_done != NULL )
+		st->opt.segment_done( st->opt.user, &st->stats );
+
+	return rc;
+}
+
+struct ts_store *ts_store_open( const char *path, const struct ts_store_options *opt )
+{
+	struct ts_store *st;
+	const char *slash, *dot;
+	void *stage;
+
+	if( strlen( path ) >= sizeof(st->base) )
+	{
+		errno = ENAMETOOLONG;
+		PERROR( "'%s'", path );
+		return NULL;
+	}
+
+	if( (st = calloc( 1, sizeof(struct ts_store) )) == NULL )
+		return NULL;
+
+	if( posix_memalign( &stage, STORE_ALIGN, TS_STORE_STAGE ) != 0 )
+	{
+		free( st );
+		return NULL;
+	}
+
+	st->stage = stage;
+	st->fd    = -1;
+
+	if( opt != NULL )
+		st->opt = *opt;
+	else
+		ts_store_default_options( &st->opt );
+
+	st->opt.segment_size = (st->opt.segment_size + TS_STORE_UNIT - 1) / TS_STORE_UNIT * TS_STORE_UNIT;
+	st->mode = st->opt.mode;
+
+	// -- mux.ts -> mux.0000.ts, and statfs() goes to the directory it is in
+	slash = strrchr( path, '/' );
+	dot   = store_ext( path );
+
+	snprintf( st->base, sizeof(st->base), "%.*s", (int) (dot - path), path );
+	snprintf( st->ext, sizeof(st->ext), "%s", dot );
+
+	if( slash == NULL )
+		strcpy( st->dir, "." );
+	else if( slash == path )
+		strcpy( st->dir, "/" );
+	else
+		snprintf( st->dir, sizeof(st->dir), "%.*s", (int) (slash - path), path );
+
+	if( store_open_segment( st ) < 0 )
+	{
+		if( st->fd >= 0 )
+		{
+			close( st->fd );
+			unlink( st->path );
+		}
+		free( st->stage );
+		free( st );
+		return NULL;
+	}
+
+	return st;
+}
+
+size_t ts_store_room( struct ts_store *st )
+{
+	if( st->opt.segment_size == 0 )
+		return (size_t) -1;
+
+	return st->opt.segment_size - st->written - st->staged;
+}
+
+int ts_store_write( struct ts_store *st, const uint8_t *packets, size_t len )
+{
+	size_t n;
+
+	if( st->fd < 0 )
+	{
+		errno = ENOSPC;
+		return -1;
+	}
+
+	if( len > ts_store_room( st ) )
+	{
+		errno = EINVAL;
+		return -1;
+	}
+
+	while( len > 0 )
+	{
+		n = TS_STORE_STAGE - st->staged;
+		if( n > len )
+			n = len;
+
+		memcpy( st->stage + st->staged, packets, n );
+		st->staged += n;
+		packets    += n;
+		len        -= n;
+
+		if( st->staged == TS_STORE_STAGE && store_flush( st ) < 0 )
+			return -1;
+	}
+
+	if( st->opt.segment_size != 0 && ts_store_room( st ) == 0 )
+	{
+		if( store_close_segment( st, 1 ) < 0 )
+			return -1;
+
+		st->segment++;
+
+		if( store_open_segment( st ) < 0 )
+		{
+			if( st->fd >= 0 )
+			{
+				close( st->fd );
+				st->fd = -1;
+			}
+			unlink( st->path );
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+int ts_store_segment( struct ts_store *st )
+{
+	return st->segment;
+}
+
+const char *ts_store_path( struct ts_store *st )
+{
+	return st->path;
+}
+
+int ts_store_close( struct ts_store *st )
+{
+	int rc = 0;
+
+	if( st == NULL )
+		return 0;
+
+	if( st->fd >= 0 )
+	{
+		// -- A segment opened just before the recording stopped has nothing in it
+		if( st->segment > 0 && st->written + st->staged == 0 )
+		{
+			close( st->fd );
+			store_remove( st, st->segment );
+		}
+		else
+			rc = store_close_segment( st, 1 );
+	}
+
+	free( st->stage );
+	free( st );
+
+	return rc;
+}
+
+uint64_t ts_store_percentile( const struct ts_store_stats *stats, double pct )
+{
+	uint64_t target, sum = 0;
+	int b;
+
+	if( stats->writes == 0 )
+		return 0;
+
+	target = (uint64_t) (stats->writes * pct / 100.0 + 0.999999);
+
+	for( b = 0; b < TS_STORE_LATENCY_BUCKETS; b++ )
+	{
+		sum += stats->latency[b];
+		if( sum >= target )
+			break;
+	}
+
+	return 1ULL << (b + 1);
+}
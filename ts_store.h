@@ -0,0 +1,105 @@
+#ifndef _TS_STORE_H_
+#define _TS_STORE_H_
+/* ts_store.h -- recorder storage: preallocated segments, direct writes
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * A recording goes to disk as fixed size segments (mux.ts becomes
+ * mux.0000.ts, mux.0001.ts, ...), or as one file when segment_size is
+ * 0. Space is reserved with fallocate() before it is written to, a
+ * segment at a time or TS_STORE_GROW at a time, so files do not
+ * fragment when several tuners record to the same disk, and running out
+ * of space is noticed when the next reservation is due rather than
+ * halfway through a write. Each reservation first checks statfs(): if
+ * it would leave less than min_free, the oldest segment of this
+ * recording is deleted (rotate) or the store refuses with ENOSPC.
+ *
+ * Packets are staged in an aligned buffer and written TS_STORE_UNIT at
+ * a time, either with O_DIRECT or through the page cache with
+ * sync_file_range() pushing out each window and dropping the one before
+ * it, so a recorder never piles up gigabytes of dirty pages. Filesystems
+ * that refuse O_DIRECT get the sync_file_range() path.
+ *
+ *	struct ts_store *st = ts_store_open( "mux.ts", &opt );
+ *	while( ... ) {
+ *		len = min( len, ts_store_room( st ) );    keeps segments whole
+ *		ts_store_write( st, packets, len );
+ *	}
+ *	ts_store_close( st );
+ *
+ * opt.segment_done is called as each segment is closed, with its write
+ * latency and throughput.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <limits.h>
+
+#define TS_STORE_UNIT                (4096 * 47)  /* whole pages and whole 188 byte packets */
+#define TS_STORE_STAGE          (TS_STORE_UNIT * 8)
+#define TS_STORE_GROW       (TS_STORE_UNIT * 1394)  /* ~256 MB, one file mode */
+#define TS_STORE_WINDOW         (TS_STORE_UNIT * 40) /* ~8 MB, sync_file_range() mode */
+#define TS_STORE_LATENCY_BUCKETS              32  /* log2 of microseconds */
+
+enum ts_store_mode {
+	TS_STORE_DIRECT,                  /* O_DIRECT */
+	TS_STORE_SYNC_RANGE,              /* page cache, written back and dropped a window at a time */
+	TS_STORE_BUFFERED,                /* plain write(), for comparison */
+};
+
+struct ts_store_stats {
+	char     path [PATH_MAX];
+	int      segment;
+	enum ts_store_mode mode;          /* what was actually used */
+	int      preallocated;            /* fallocate() worked */
+
+	uint64_t bytes;
+	uint64_t start_us;
+	uint64_t end_us;
+
+	uint64_t writes;
+	uint64_t write_us;                /* total time spent in them */
+	uint64_t max_us;
+	uint32_t latency [TS_STORE_LATENCY_BUCKETS];
+
+	uint64_t free_bytes;              /* at the last statfs() */
+	int      removed;                 /* segments rotated away to make room for this one */
+};
+
+struct ts_store_options {
+	uint64_t segment_size;            /* rounded up to TS_STORE_UNIT, 0 = one file */
+	enum ts_store_mode mode;
+	uint64_t min_free;                /* bytes to leave free on the filesystem */
+	int      rotate;                  /* delete the oldest segment rather than refuse */
+	const char *sidecar;              /* suffix of a file that goes with each segment, e.g. the index */
+
+	void   (*segment_done)( void *user, const struct ts_store_stats *stats );
+	void    *user;
+};
+
+struct ts_store;
+
+extern void             ts_store_default_options( struct ts_store_options *opt );
+extern struct ts_store *ts_store_open( const char *path, const struct ts_store_options *opt );
+
+/* Bytes the current segment still takes; writes must not exceed it */
+extern size_t           ts_store_room( struct ts_store *st );
+extern int              ts_store_write( struct ts_store *st, const uint8_t *packets, size_t len );
+
+/* Segment being written, changes inside ts_store_write() when one fills */
+extern int              ts_store_segment( struct ts_store *st );
+extern const char      *ts_store_path( struct ts_store *st );
+
+extern int              ts_store_close( struct ts_store *st );
+
+/* The naming of a series: segment 3 of mux.ts is mux.0003.ts, and
+ * ts_store_segment_number() gives 3 back for that name, -1 for any
+ * name that is not a segment of path */
+extern int              ts_store_segment_name( const char *path, int segment, char *name, size_t size );
+extern int              ts_store_segment_number( const char *path, const char *name );
+
+/* Upper bound of the bucket holding the given percentile, in us */
+extern uint64_t         ts_store_percentile( const struct ts_store_stats *stats, double pct );
+
+
+#endif /* _TS_STORE_H_ */
@@ -0,0 +1,402 @@
+/* zap.c -- tune a virtual channel straight from the scan cache
+ *
+ * Kevin Fowlks <fowlks(at)msu.edu>
+ *
+ * Everything needed to tune (frequency, modulation and every elementary
+ * PID) comes from channels.cache, so there is no PSIP to wait for. The
+ * demux filters are set while the frontend is still acquiring lock, and
+ * the time from FE_SET_FRONTEND to lock and to the first TS packet on
+ * the dvr is reported.
+ *
+ * Unless -x is given the filters stay in place until Ctrl-C, so the
+ * dvr device can be read by a recorder or player, as with azap -r.
+ *
+ * With -D the dvr is not released: atsc_zap becomes the tuner daemon
+ * that reads it and writes the TS into a shared memory ring (a memfd,
+ * see ts_ring.h), reading straight into the ring. Local consumers such
+ * as atsc_tap connect on the unix socket, map it read only and follow
+ * it with cursors of their own, so a recorder, an analyzer and the
+ * gateway can all share one tuner with no copy per consumer. -A taps
+ * the whole mux instead of the channel's PIDs.
+ */
+
+#include <sys/types.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+
+#include "common.h"
+#include "channels.h"
+#include "dvb_device.h"
+#include "ts_ring.h"
+
+#define CHANNEL_FILE "channels.cache"
+#define SYNC_BYTE                           0x47
+#define PAT_PID                             0x0000
+#define TS_PACKET_SIZE                       188
+#define TUNE_TIMEOUT_MS                     5000
+#define MAX_FILTERS      (CHANNEL_MAX_PIDS + 2)
+#define ALL_PIDS                          0x2000
+#define DVR_READ_SIZE      (TS_PACKET_SIZE * 348)
+#define RING_SIZE               (16 * 1024 * 1024)
+#define STALL_MS                             100  /* longest wait for a blocking consumer */
+#define STATS_INTERVAL_US               10000000
+
+struct filters {
+	int      num;
+	int      fd [MAX_FILTERS];
+	uint16_t pid [MAX_FILTERS];
+};
+
+static volatile sig_atomic_t running = 1;
+
+
+static void stop( int sig )
+{
+	running = 0;
+}
+
+/*
+  ###############################################################
+  #    One TS tap pes filter per PID                            #
+  ###############################################################
+*/
+static int add_filter( struct dvb_device *dev, struct filters *f, uint16_t pid )
+{
+	struct dmx_pes_filter_params pes;
+	int i, fd;
+
+	for( i = 0; i < f->num; i++ )
+	{
+		if( f->pid[i] == pid )
+			return 0;
+	}
+
+	if( f->num == MAX_FILTERS )
+		return -1;
+
+	if( (fd = dvb_open_demux( dev )) < 0 )
+	{
+		PERROR( "failed opening '%s'", dev->demux_dev );
+		return -1;
+	}
+
+	memset( &pes, 0, sizeof(pes) );
+	pes.pid      = pid;
+	pes.input    = DMX_IN_FRONTEND;
+	pes.output   = DMX_OUT_TS_TAP;
+	pes.pes_type = DMX_PES_OTHER;
+	pes.flags    = DMX_IMMEDIATE_START;
+
+	if( dvb_set_pes_filter( dev, fd, &pes ) < 0 )
+	{
+		PERROR( "DMX_SET_PES_FILTER pid 0x%x", pid );
+		dvb_close_fd( dev, fd );
+		return -1;
+	}
+
+	f->fd[f->num]  = fd;
+	f->pid[f->num] = pid;
+	f->num++;
+
+	return 0;
+}
+
+/*
+  ###############################################################
+  #    Daemon: dvr straight into the shared ring                #
+  ###############################################################
+*/
+static void print_readers( struct ts_ring *ring )
+{
+	struct ts_ring_slot *s;
+	int i;
+
+	for( i = 0; i < TS_RING_MAX_READERS; i++ )
+	{
+		s = &ring->slots->slot[i];
+		if( !s->in_use )
+			continue;
+
+		printf( "  reader %2d %-5s %12llu behind %12llu dropped %6llu stalls\n", i,
+			s->policy != TS_RING_BLOCK ? "drop" : s->stalled ? "stall" : "block",
+			(unsigned long long) (ts_ring_head( ring ) - s->cursor),
+			(unsigned long long) s->dropped, (unsigned long long) s->stalls );
+	}
+}
+
+static int serve( struct dvb_device *dev, int dvrfd, const uint8_t *first, size_t first_len,
+		  const char *socket_path, size_t ring_size, unsigned stall_ms )
+{
+	struct ts_ring *ring;
+	uint64_t overflows = 0, last_stats;
+	size_t len, partial = 0;
+	uint8_t *p;
+	ssize_t n;
+
+	if( (ring = ts_ring_create_memfd( "atsc_zap", ring_size, stall_ms )) == NULL )
+		return -1;
+
+	if( ts_ring_serve( ring, socket_path ) < 0 )
+	{
+		PERROR( "failed listening on '%s'", socket_path );
+		ts_ring_close( ring );
+		return -1;
+	}
+
+	signal( SIGINT, stop );
+	signal( SIGTERM, stop );
+
+	printf( "Serving %zu byte ring on '%s', Ctrl-C to stop\n", (size_t) ring->hdr->size, socket_path );
+
+	// -- The first read can end inside a packet, its start goes where the next read lands
+	ts_ring_write( ring, first, first_len - first_len % TS_PACKET_SIZE );
+
+	if( (partial = first_len % TS_PACKET_SIZE) > 0 )
+	{
+		len = DVR_READ_SIZE;
+		p = ts_ring_reserve( ring, &len );
+		memcpy( p, first + first_len - partial, partial );
+	}
+
+	last_stats = dvb_clock_us( dev );
+
+	while( running )
+	{
+		len = DVR_READ_SIZE;
+		p = ts_ring_reserve( ring, &len );
+
+		n = dvb_read( dev, dvrfd, p + partial, len - partial );
+		if( n < 0 )
+		{
+			// -- The dvr starts over on a packet boundary, what we had of the last one is lost
+			if( errno == EOVERFLOW )
+			{
+				overflows++;
+				partial = 0;
+			}
+			else if( errno != EINTR && errno != EAGAIN )
+			{
+				PERROR( "read from '%s'", dev->dvr_dev );
+				break;
+			}
+			continue;
+		}
+
+		if( n == 0 )
+			break;
+
+		// -- Publish whole packets; a partial one stays put at the new head
+		ts_ring_commit( ring, partial + n );
+		partial = (partial + n) % TS_PACKET_SIZE;
+
+		if( dvb_clock_us( dev ) - last_stats >= STATS_INTERVAL_US )
+		{
+			printf( "%llu bytes, %llu dvr overflows\n", (unsigned long long) ts_ring_head( ring ),
+				(unsigned long long) overflows );
+			print_readers( ring );
+			last_stats = dvb_clock_us( dev );
+		}
+	}
+
+	printf( "%llu bytes, %llu dvr overflows\n", (unsigned long long) ts_ring_head( ring ), (unsigned long long) overflows );
+	print_readers( ring );
+
+	ts_ring_close( ring );
+
+	return 0;
+}
+
+/*###############################################################
+  #   Display usage and exit                                    #
+  ###############################################################*/
+void usage()
+{
+     fprintf( stdout, "usage: atsc_zap [options] <major.minor | name>\n" );
+     fprintf( stdout, "  -a adapter        DVB adapter number [Default: 0]\n" );
+     fprintf( stdout, "  -f file           scan cache [Default: %s]\n", CHANNEL_FILE );
+     fprintf( stdout, "  -x                exit once the first packet arrived\n" );
+     fprintf( stdout, "  -D socket         tuner daemon: serve the TS to local readers on socket\n" );
+     fprintf( stdout, "  -A                with -D, the whole mux instead of the channel's PIDs\n" );
+     fprintf( stdout, "  -r bytes          with -D, ring size [Default: %d]\n", RING_SIZE );
+     fprintf( stdout, "  -w ms             with -D, longest wait for a blocking reader [Default: %d]\n", STALL_MS );
+     fprintf( stdout, "  --sim scenario    use a simulated adapter (see dvb_sim.c)\n" );
+     exit( 0 );
+}
+
+/*###############################################################
+  #  Main program Entry                                         #
+  ###############################################################*/
+int main( int argc, char *argv[] )
+{
+	static const struct option long_opts[] = {
+		{ "sim",  required_argument, NULL, 's' },
+		{ "help", no_argument,       NULL, 'h' },
+		{ NULL, 0, NULL, 0 }
+	};
+
+	struct channel_list list;
+	struct channel_entry *channel;
+	struct dvb_device *dev;
+	struct dvb_frontend_parameters frontend;
+	uint8_t pkt[TS_PACKET_SIZE * 8];
+	uint64_t t_tune, t_lock, t_first;
+	ssize_t n;
+	char *file = CHANNEL_FILE, *scenario = NULL, *socket_path = NULL;
+	struct filters filters;
+	size_t ring_size = RING_SIZE;
+	unsigned stall_ms = STALL_MS;
+	int adapter = 0, exit_after = 0, whole_mux = 0;
+	int dvrfd, c, i, rc = 0;
+
+	while( (c = getopt_long( argc, argv, "a:f:xD:Ar:w:h", long_opts, NULL )) != -1 )
+	{
+		switch( c )
+		{
+		case 'a': adapter = atoi( optarg ); break;
+		case 'f': file = optarg; break;
+		case 'x': exit_after = 1; break;
+		case 'D': socket_path = optarg; break;
+		case 'A': whole_mux = 1; break;
+		case 'r': ring_size = strtoul( optarg, NULL, 0 ); break;
+		case 'w': stall_ms = atoi( optarg ); break;
+		case 's': scenario = optarg; break;
+		default:  usage();
+		}
+	}
+
+	memset( &filters, 0, sizeof(filters) );
+
+	if( optind != argc - 1 )
+		usage();
+
+	if( channels_load( file, &list ) < 0 )
+		return -1;
+
+	if( (channel = channels_find( &list, argv[optind] )) == NULL )
+	{
+		ERROR( "channel '%s' not found in %s", argv[optind], file );
+		return -1;
+	}
+
+	if( scenario != NULL )
+		dev = dvb_open_sim( scenario );
+	else
+		dev = dvb_open_hw( adapter, 0, 0, 0 );
+
+	if( dev == NULL )
+		return -1;
+
+	printf( "%u.%u %s: %u Hz %s, program %u, PMT %u, %d PIDs\n", channel->major, channel->minor, channel->name,
+		channel->freq, modulation_name( channel->modulation ), channel->program, channel->pmt_pid, channel->num_pids );
+
+	memset( &frontend, 0, sizeof(frontend) );
+	frontend.frequency = channel->freq;
+	frontend.u.vsb.modulation = channel->modulation;
+
+	t_tune = dvb_clock_us( dev );
+
+	if( dvb_set_frontend( dev, &frontend ) < 0 )
+	{
+		PERROR( "ioctl FE_SET_FRONTEND failed" );
+		return -1;
+	}
+
+	// -- Program the demux while the frontend acquires lock
+	if( socket_path != NULL && whole_mux )
+	{
+		if( add_filter( dev, &filters, ALL_PIDS ) < 0 )
+			return -1;
+	}
+	else
+	{
+		if( add_filter( dev, &filters, PAT_PID ) < 0 )
+			return -1;
+
+		// -- Without the PMT a player behind the socket can't find the streams
+		if( channel->pmt_pid != 0 && add_filter( dev, &filters, channel->pmt_pid ) < 0 )
+			return -1;
+
+		if( channel->pcr_pid != 0 && add_filter( dev, &filters, channel->pcr_pid ) < 0 )
+			return -1;
+
+		for( i = 0; i < channel->num_pids; i++ )
+		{
+			if( add_filter( dev, &filters, channel->pids[i] ) < 0 )
+				return -1;
+		}
+	}
+
+	if( (dvrfd = dvb_open_dvr( dev )) < 0 )
+	{
+		PERROR( "failed opening '%s'", dev->dvr_dev );
+		return -1;
+	}
+
+	if( dvb_wait_lock( dev, TUNE_TIMEOUT_MS ) < 0 )
+	{
+		ERROR( "no lock on %u Hz", channel->freq );
+		return -1;
+	}
+
+	t_lock = dvb_clock_us( dev );
+
+	do
+	{
+		n = dvb_read( dev, dvrfd, pkt, sizeof(pkt) );
+	} while( n < 0 && (errno == EINTR || errno == EOVERFLOW) );
+
+	if( n < 0 )
+	{
+		PERROR( "no transport stream on '%s'", dev->dvr_dev );
+		return -1;
+	}
+
+	if( n < TS_PACKET_SIZE || pkt[0] != SYNC_BYTE )
+	{
+		ERROR( "no transport stream on '%s'", dev->dvr_dev );
+		return -1;
+	}
+
+	t_first = dvb_clock_us( dev );
+
+	printf( "lock           %6.1f ms\n", (t_lock - t_tune) / 1000.0 );
+	printf( "first packet   %6.1f ms\n", (t_first - t_tune) / 1000.0 );
+
+	for( i = 0; i < channel->num_pids; i++ )
+		printf( "PID %4u (0x%04x) type 0x%02x %s\n", channel->pids[i], channel->pids[i], channel->types[i], channel->langs[i] );
+
+	if( socket_path != NULL )
+	{
+		rc = serve( dev, dvrfd, pkt, n, socket_path, ring_size, stall_ms );
+		dvb_close_fd( dev, dvrfd );
+	}
+	else
+	{
+		// -- Let someone else read the dvr
+		dvb_close_fd( dev, dvrfd );
+	}
+
+	if( socket_path == NULL && !exit_after )
+	{
+		signal( SIGINT, stop );
+		signal( SIGTERM, stop );
+
+		printf( "Filters set on '%s', Ctrl-C to release\n", dev->dvr_dev );
+		while( running )
+			pause();
+	}
+
+	for( i = 0; i < filters.num; i++ )
+		dvb_close_fd( dev, filters.fd[i] );
+
+	dvb_close( dev );
+	channels_free( &list );
+
+	return rc;
+}